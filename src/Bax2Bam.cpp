@@ -4,9 +4,10 @@
 #include "CcsConverter.h"
 #include "HqRegionConverter.h"
 #include "PolymeraseReadConverter.h"
+#include "ReadaheadFileDriver.h"
 #include "SubreadConverter.h"
+#include "ZmwSelection.h"
 #include <pbbam/DataSet.h>
-#include <pbbam/PbiRawData.h>
 #include <boost/algorithm/string.hpp>
 #include <memory>
 #include <fstream>
@@ -31,6 +32,7 @@ std::string CurrentWorkingDir(void)
 
 static
 bool WriteDatasetXmlOutput(const Settings& settings,
+                           const IConverter::OutputStats& mainStats,
                            std::vector<std::string>* errors)
 {
     using namespace PacBio::BAM;
@@ -177,24 +179,18 @@ bool WriteDatasetXmlOutput(const Settings& settings,
         resources.Add(mainBam);
         dataset.ExternalResources(resources);
 
-        // update TotalLength & NumRecords
-        const BamFile subreadFile{ settings.outputBamFilename };
-        const std::string subreadPbiFn = subreadFile.PacBioIndexFilename();
-        const PbiRawData subreadsIndex{ subreadPbiFn };
-        const PbiRawBasicData& subreadData = subreadsIndex.BasicData();
-
-        uint64_t totalLength = 0;
-        uint32_t numRecords = subreadsIndex.NumReads();
-        for (uint32_t i = 0; i < numRecords; ++i) {
-            const auto subreadLength = subreadData.qEnd_.at(i) - subreadData.qStart_.at(i);
-            totalLength += subreadLength;
-        }
-
+        // update TotalLength & NumRecords (counted during conversion)
         DataSetMetadata metadata = dataset.Metadata();
-        metadata.TotalLength(std::to_string(totalLength));
-        metadata.NumRecords(std::to_string(numRecords));
+        metadata.TotalLength(std::to_string(mainStats.totalLength));
+        metadata.NumRecords(std::to_string(mainStats.numRecords));
         dataset.Metadata(metadata);
 
+        // record any ZMW subsample
+        std::string tags = dataset.Tags();
+        for (const std::string& tag : ZmwSelection(settings).Tags())
+            tags += (tags.empty() ? "" : ",") + tag;
+        dataset.Tags(tags);
+
         // save to file
         std::string xmlFn = settings.outputXmlFilename; // try user-provided explicit filename first
         if (xmlFn.empty())
@@ -208,6 +204,73 @@ bool WriteDatasetXmlOutput(const Settings& settings,
     }
 }
 
+// Time compressing & writing an output, and with adaptive compression,
+// "<level> (<percent>%), ..." of the data written at each deflate level.
+static
+void PrintCompression(const Settings& settings,
+                      const std::string& label,
+                      const IConverter::OutputStats& stats)
+{
+    uint64_t totalBytes = 0;
+    for (const uint64_t numBytes : stats.bytesAtLevel)
+        totalBytes += numBytes;
+    if (totalBytes == 0)
+        return;
+
+    std::cerr << label << ": " << stats.compressSeconds << " s compressing (all threads), "
+              << stats.writeSeconds << " s writing" << std::endl;
+    if (!settings.adaptiveCompression)
+        return;
+
+    std::cerr << label << " compression levels: ";
+    const char* separator = "";
+    for (size_t level = 0; level < stats.bytesAtLevel.size(); ++level) {
+        if (stats.bytesAtLevel.at(level) == 0)
+            continue;
+        std::cerr << separator << level << " (" << (100.0 * stats.bytesAtLevel.at(level) / totalBytes) << "%)";
+        separator = ", ";
+    }
+    std::cerr << std::endl;
+}
+
+static
+void PrintRunReport(const Settings& settings,
+                    const IConverter::InputStats& stats,
+                    const IConverter::OutputStats& mainStats,
+                    const IConverter::OutputStats& scrapsStats)
+{
+    std::cerr << "HDF5 chunk cache: ";
+    if (stats.chunkCacheBytes == 0)
+        std::cerr << "HDF5 default" << std::endl;
+    else {
+        std::cerr << stats.chunkCacheBytes << " bytes, " << stats.chunkCacheSlots
+                  << " slots, for each of " << stats.numCachedDatasets << " datasets" << std::endl;
+    }
+
+    const uint64_t numChunks = stats.numChunkHits + stats.numChunkMisses;
+    std::cerr << "BaseCalls chunks: " << stats.numChunkHits << " hits, "
+              << stats.numChunkMisses << " misses";
+    if (numChunks > 0)
+        std::cerr << " (" << (100.0 * stats.numChunkHits / numChunks) << "% hits)";
+    std::cerr << std::endl;
+
+    std::cerr << "ZMWs skipped, without output: " << stats.numZmwsSkipped << std::endl;
+    if (settings.minReadScore > 0.0f || settings.minHqLength > 0)
+        std::cerr << "ZMWs filtered: " << stats.numZmwsFiltered << std::endl;
+    if (settings.minSubreadLength > 0)
+        std::cerr << "subreads filtered: " << stats.numRecordsFiltered << std::endl;
+
+    if (settings.usingReadaheadVfd) {
+        const ReadaheadFileDriver::Stats vfdStats = ReadaheadFileDriver::TotalStats();
+        std::cerr << "readahead VFD: read " << vfdStats.bytesRead << " bytes in "
+                  << vfdStats.numReads << " reads, for " << vfdStats.bytesRequested
+                  << " bytes requested" << std::endl;
+    }
+
+    PrintCompression(settings, "main BAM", mainStats);
+    PrintCompression(settings, "scraps BAM", scrapsStats);
+}
+
 } // namespace internal
 
 int Bax2Bam::Run(Settings& settings) {
@@ -232,11 +295,16 @@ int Bax2Bam::Run(Settings& settings) {
 
         // if given dataset XML as input, attempt write dataset XML output
         if (!settings.datasetXmlFilename.empty()) {
-            if (!internal::WriteDatasetXmlOutput(settings, &xmlErrors))
+            if (!internal::WriteDatasetXmlOutput(settings, converter->MainOutputStats(), &xmlErrors))
                 success = false;
         }
     }
 
+    // run report
+    if (settings.isReporting)
+        internal::PrintRunReport(settings, converter->InputStatistics(),
+                                 converter->MainOutputStats(), converter->ScrapsOutputStats());
+
     // return success/fail
     if (success)
         return EXIT_SUCCESS;
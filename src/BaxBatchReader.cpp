@@ -0,0 +1,539 @@
+#include "BaxBatchReader.h"
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#else
+#include <zlib.h>
+#endif
+
+namespace internal {
+
+static const char* const BaseCallsGroup   = "/PulseData/BaseCalls";
+static const char* const DyeSetGroup      = "/ScanData/DyeSet";
+static const char* const DefaultBaseMap   = "TGAC";
+
+static inline
+std::unique_lock<std::mutex> HdfLock(std::mutex* hdfMutex)
+{
+    return (hdfMutex ? std::unique_lock<std::mutex>(*hdfMutex)
+                     : std::unique_lock<std::mutex>());
+}
+
+static inline
+bool Includes(const std::vector<std::string>& fields, const std::string& name)
+{ return std::find(fields.cbegin(), fields.cend(), name) != fields.cend(); }
+
+// Reads a whole 1-D dataset.
+template<typename T>
+static void ReadAll(const H5::DataSet& dataset,
+                    const H5::PredType& type,
+                    std::vector<T>* data)
+{
+    const H5::DataSpace space = dataset.getSpace();
+    hsize_t size = 0;
+    space.getSimpleExtentDims(&size);
+    data->resize(size);
+    if (size > 0)
+        dataset.read(data->data(), type);
+}
+
+// Inflates a zlib stream (as written by the HDF5 deflate filter) of known
+// inflated size.
+static bool Inflate(const unsigned char* in, const size_t inSize,
+                    unsigned char* out, const size_t outSize)
+{
+#ifdef HAVE_LIBDEFLATE
+    struct Decompressor
+    {
+        libdeflate_decompressor* d;
+        Decompressor(void) : d(libdeflate_alloc_decompressor()) { }
+        ~Decompressor(void) { libdeflate_free_decompressor(d); }
+    };
+    static thread_local Decompressor decompressor;
+    size_t size = 0;
+    return decompressor.d &&
+           libdeflate_zlib_decompress(decompressor.d, in, inSize, out, outSize, &size) == LIBDEFLATE_SUCCESS &&
+           size == outSize;
+#else
+    uLongf size = outSize;
+    return uncompress(out, &size, in, inSize) == Z_OK && size == outSize;
+#endif
+}
+
+// HQRegionSNR columns are in the movie's base map order (e.g. "TGAC")
+static std::string ReadBaseMap(const H5::H5File& file)
+{
+    if (!H5Lexists(file.getId(), "/ScanData", H5P_DEFAULT) ||
+        !H5Lexists(file.getId(), DyeSetGroup, H5P_DEFAULT))
+    {
+        return DefaultBaseMap;
+    }
+
+    const H5::Group dyeSet = file.openGroup(DyeSetGroup);
+    if (!dyeSet.attrExists("BaseMap"))
+        return DefaultBaseMap;
+
+    const H5::Attribute attribute = dyeSet.openAttribute("BaseMap");
+    std::string baseMap;
+    attribute.read(attribute.getStrType(), baseMap);
+    return baseMap;
+}
+
+} // namespace internal
+
+size_t BaxBatchReader::Columns::NumBytes(void) const
+{
+    return zmwIndices.size()      * sizeof(size_t) +
+           offsets.size()         * sizeof(uint64_t) +
+           holeNumbers.size()     * sizeof(UInt) +
+           holeStatus.size()      +
+           hqRegionSnr.size()     * sizeof(float) +
+           basecall.size()        +
+           deletionQV.size()      +
+           deletionTag.size()     +
+           insertionQV.size()     +
+           mergeQV.size()         +
+           substitutionQV.size()  +
+           substitutionTag.size() +
+           preBaseFrames.size()   * sizeof(HalfWord) +
+           widthInFrames.size()   * sizeof(HalfWord);
+}
+
+BaxBatchReader::BaxBatchReader(const std::string& filename,
+                               const std::vector<std::string>& fields,
+                               const H5::FileAccPropList& fileAccess,
+                               std::mutex* hdfMutex,
+                               TaskPool* inflatePool)
+    : hdfMutex_(hdfMutex)
+    , inflatePool_(inflatePool)
+    , numJobs_(0)
+    , numChunkHits_(0)
+    , numChunkMisses_(0)
+    , nextZmw_(0)
+    , numZmwsSkipped_(0)
+    , includeHqRegionSnr_(internal::Includes(fields, "HQRegionSNR"))
+{
+    std::unique_lock<std::mutex> lock = internal::HdfLock(hdfMutex_);
+    try {
+        file_.openFile(filename, H5F_ACC_RDONLY, fileAccess);
+        baseCalls_ = file_.openGroup(internal::BaseCallsGroup);
+
+        // ZMW offsets, from NumEvent
+        std::vector<int32_t> numEvents;
+        internal::ReadAll(baseCalls_.openDataSet("ZMW/NumEvent"), H5::PredType::NATIVE_INT32, &numEvents);
+        numEventOffsets_.resize(numEvents.size() + 1);
+        numEventOffsets_[0] = 0;
+        for (size_t i = 0; i < numEvents.size(); ++i)
+            numEventOffsets_[i+1] = numEventOffsets_[i] + static_cast<uint64_t>(numEvents[i]);
+
+        internal::ReadAll(baseCalls_.openDataSet("ZMW/HoleNumber"), H5::PredType::NATIVE_UINT32, &holeNumbers_);
+        internal::ReadAll(baseCalls_.openDataSet("ZMW/HoleStatus"), H5::PredType::NATIVE_UCHAR, &holeStatus_);
+        if (holeNumbers_.size() != NumZmws() || holeStatus_.size() != NumZmws())
+            throw std::runtime_error("inconsistent ZMW datasets");
+
+        // no SNRs are stored (all 0) if the file has none
+        includeHqRegionSnr_ = includeHqRegionSnr_ &&
+                              H5Lexists(baseCalls_.getId(), "ZMWMetrics", H5P_DEFAULT) > 0 &&
+                              H5Lexists(baseCalls_.getId(), "ZMWMetrics/HQRegionSNR", H5P_DEFAULT) > 0;
+        if (includeHqRegionSnr_) {
+            hqRegionSnr_ = baseCalls_.openDataSet("ZMWMetrics/HQRegionSNR");
+            const std::string baseMap = internal::ReadBaseMap(file_);
+            const char bases[4] = { 'A', 'C', 'G', 'T' };
+            for (size_t i = 0; i < 4; ++i) {
+                const size_t column = baseMap.find(bases[i]);
+                if (column == std::string::npos || column > 3)
+                    throw std::runtime_error("invalid BaseMap: "+baseMap);
+                snrChannel_[i] = static_cast<int>(column);
+            }
+        }
+
+        OpenField(fields, "Basecall",        H5::PredType::NATIVE_UCHAR,  &basecall_);
+        OpenField(fields, "DeletionQV",      H5::PredType::NATIVE_UCHAR,  &deletionQV_);
+        OpenField(fields, "DeletionTag",     H5::PredType::NATIVE_UCHAR,  &deletionTag_);
+        OpenField(fields, "InsertionQV",     H5::PredType::NATIVE_UCHAR,  &insertionQV_);
+        OpenField(fields, "MergeQV",         H5::PredType::NATIVE_UCHAR,  &mergeQV_);
+        OpenField(fields, "SubstitutionQV",  H5::PredType::NATIVE_UCHAR,  &substitutionQV_);
+        OpenField(fields, "SubstitutionTag", H5::PredType::NATIVE_UCHAR,  &substitutionTag_);
+        OpenField(fields, "PreBaseFrames",   H5::PredType::NATIVE_UINT16, &preBaseFrames_);
+        OpenField(fields, "WidthInFrames",   H5::PredType::NATIVE_UINT16, &widthInFrames_);
+
+    } catch (H5::Exception& e) {
+        throw std::runtime_error("could not read BaseCalls from "+filename+": "+e.getDetailMsg());
+    }
+}
+
+void BaxBatchReader::OpenField(const std::vector<std::string>& fields,
+                               const std::string& name,
+                               const H5::PredType& type,
+                               BaseField* field)
+{
+    field->name = name;
+
+    // requested fields missing from the file are left empty, the converter
+    // reports them as unavailable
+    field->included = internal::Includes(fields, name) &&
+                      H5Lexists(baseCalls_.getId(), name.c_str(), H5P_DEFAULT) > 0;
+    if (!field->included)
+        return;
+    field->dataset = baseCalls_.openDataSet(name);
+
+#if H5_VERSION_GE(1,10,2)
+    // Direct chunk reads need 1-D chunks, stored as the in-memory type, and
+    // only filters we can undo: deflate, possibly after shuffle.
+    const H5::DSetCreatPropList plist = field->dataset.getCreatePlist();
+    if (plist.getLayout() != H5D_CHUNKED || !(field->dataset.getDataType() == type))
+        return;
+    hsize_t chunkSize = 0;
+    if (plist.getChunk(1, &chunkSize) != 1 || chunkSize == 0)
+        return;
+
+    const int numFilters = plist.getNfilters();
+    if (numFilters < 0 || numFilters > 2)
+        return;
+    int deflateIndex = -1;
+    int shuffleIndex = -1;
+    for (int i = 0; i < numFilters; ++i) {
+        unsigned int flags = 0;
+        size_t numValues = 0;
+        unsigned int filterConfig = 0;
+        const H5Z_filter_t filter = H5Pget_filter2(plist.getId(), static_cast<unsigned>(i),
+                                                   &flags, &numValues, nullptr, 0, nullptr, &filterConfig);
+        if      (filter == H5Z_FILTER_DEFLATE && deflateIndex < 0) deflateIndex = i;
+        else if (filter == H5Z_FILTER_SHUFFLE && shuffleIndex < 0) shuffleIndex = i;
+        else return;
+    }
+    if (deflateIndex >= 0 && shuffleIndex > deflateIndex)
+        return;
+
+    field->direct = true;
+    field->chunkSize = chunkSize;
+    field->elementSize = type.getSize();
+    field->shuffled = (shuffleIndex >= 0);
+    field->deflateFilterBit = (deflateIndex >= 0 ? static_cast<unsigned>(deflateIndex) : 32);
+    field->shuffleFilterBit = (shuffleIndex >= 0 ? static_cast<unsigned>(shuffleIndex) : 32);
+#else
+    (void)type;
+#endif
+}
+
+void BaxBatchReader::ReadSlabs(BaseField& field,
+                               const Run* begin,
+                               const Run* end,
+                               void* data,
+                               const H5::PredType& type)
+{
+    H5::DataSpace fileSpace = field.dataset.getSpace();
+    hsize_t total = 0;
+    for (const Run* run = begin; run != end; ++run) {
+        hsize_t count = run->end - run->begin;
+        hsize_t start = run->begin;
+        fileSpace.selectHyperslab(run == begin ? H5S_SELECT_SET : H5S_SELECT_OR, &count, &start);
+        total += count;
+    }
+    const H5::DataSpace memorySpace(1, &total);
+    field.dataset.read(data, type, memorySpace, fileSpace);
+}
+
+bool BaxBatchReader::ReadRawChunk(BaseField& field,
+                                  const hsize_t chunk,
+                                  ChunkJob* job)
+{
+#if H5_VERSION_GE(1,10,2)
+    const hid_t dataset = field.dataset.getId();
+    hsize_t offset = chunk * field.chunkSize;
+    hsize_t storageSize = 0;
+    uint32_t filterMask = 0;
+    herr_t status = -1;
+
+    // unallocated chunks (fill values only) are left to the filter pipeline
+    H5E_BEGIN_TRY {
+        status = H5Dget_chunk_storage_size(dataset, &offset, &storageSize);
+        if (status >= 0 && storageSize > 0) {
+            job->compressed.resize(storageSize);
+            status = H5Dread_chunk(dataset, H5P_DEFAULT, &offset, &filterMask, job->compressed.data());
+        }
+    } H5E_END_TRY;
+    if (status < 0 || storageSize == 0)
+        return false;
+
+    job->field = &field;
+    job->chunk = chunk;
+    job->filterMask = filterMask;
+    job->error.clear();
+    return true;
+#else
+    (void)field;
+    (void)chunk;
+    (void)job;
+    return false;
+#endif
+}
+
+void BaxBatchReader::InflateChunk(ChunkJob* job)
+{
+    const BaseField& field = *job->field;
+    const size_t elementSize = field.elementSize;
+    const size_t chunkBytes = field.chunkSize * elementSize;
+
+    // undo the filters applied to this chunk, into 'inflated'
+    const bool deflated = field.deflateFilterBit < 32 &&
+                          (job->filterMask & (1u << field.deflateFilterBit)) == 0;
+    if (deflated) {
+        job->inflated.resize(chunkBytes);
+        if (!internal::Inflate(job->compressed.data(), job->compressed.size(),
+                               job->inflated.data(), chunkBytes))
+        {
+            job->error = "could not inflate chunk";
+            return;
+        }
+    } else {
+        if (job->compressed.size() != chunkBytes) {
+            job->error = "unexpected chunk size";
+            return;
+        }
+        job->inflated.swap(job->compressed);
+    }
+
+    const bool shuffled = field.shuffled && elementSize > 1 &&
+                          (job->filterMask & (1u << field.shuffleFilterBit)) == 0;
+    if (shuffled) {
+        // byte 'b' of element 'i' was stored at b*numElements + i
+        const size_t numElements = field.chunkSize;
+        job->scratch.resize(chunkBytes);
+        for (size_t b = 0; b < elementSize; ++b) {
+            const unsigned char* in = job->inflated.data() + b*numElements;
+            unsigned char* out = job->scratch.data() + b;
+            for (size_t i = 0; i < numElements; ++i)
+                out[i*elementSize] = in[i];
+        }
+        job->inflated.swap(job->scratch);
+    }
+
+    for (const ChunkCopy& copy : job->copies) {
+        memcpy(copy.destination,
+               job->inflated.data() + copy.first*elementSize,
+               copy.count*elementSize);
+    }
+}
+
+template<typename T>
+void BaxBatchReader::ReadRuns(BaseField& field,
+                              const uint64_t numBases,
+                              std::vector<T>* data,
+                              const H5::PredType& type)
+{
+    if (!field.included) {
+        data->clear();
+        return;
+    }
+
+    data->resize(numBases);
+    if (numBases == 0)
+        return;
+    if (!field.direct) {
+        ReadSlabs(field, runs_.data(), runs_.data() + runs_.size(), data->data(), type);
+        return;
+    }
+
+    // Fetch the raw chunks overlapping the runs (they are inflated later,
+    // once all HDF5 reads for the batch are done). A chunk shared by several
+    // runs is read once.
+    const size_t elementSize = field.elementSize;
+    const uint64_t chunkSize = field.chunkSize;
+    unsigned char* destination = reinterpret_cast<unsigned char*>(data->data());
+    for (const Run& run : runs_) {
+        const hsize_t firstChunk = run.begin / chunkSize;
+        const hsize_t lastChunk  = (run.end - 1) / chunkSize;
+        for (hsize_t chunk = firstChunk; chunk <= lastChunk; ++chunk) {
+            const uint64_t chunkBegin = chunk * chunkSize;
+            const uint64_t rangeBegin = std::max(run.begin, chunkBegin);
+            const uint64_t rangeEnd   = std::min(run.end, chunkBegin + chunkSize);
+            const ChunkCopy copy{ destination, rangeBegin - chunkBegin, rangeEnd - rangeBegin };
+            destination += copy.count * elementSize;
+
+            if (chunk == field.cachedChunk) {
+                memcpy(copy.destination,
+                       field.cachedData.data() + copy.first*elementSize,
+                       copy.count*elementSize);
+                ++numChunkHits_;
+                continue;
+            }
+            if (numJobs_ > 0 && jobs_[numJobs_-1].field == &field && jobs_[numJobs_-1].chunk == chunk) {
+                jobs_[numJobs_-1].copies.push_back(copy);
+                ++numChunkHits_;
+                continue;
+            }
+
+            ++numChunkMisses_;
+            if (numJobs_ == jobs_.size())
+                jobs_.emplace_back();
+            ChunkJob& job = jobs_[numJobs_];
+            if (!ReadRawChunk(field, chunk, &job)) {
+                const Run range{ rangeBegin, rangeEnd };
+                ReadSlabs(field, &range, &range + 1, copy.destination, type);
+                continue;
+            }
+            job.copies.assign(1, copy);
+            ++numJobs_;
+        }
+    }
+}
+
+void BaxBatchReader::Select(const std::vector<bool>& selected)
+{
+    if (!selected.empty() && selected.size() != NumZmws())
+        throw std::runtime_error("ZMW selection does not match the number of ZMWs");
+    selected_ = selected;
+}
+
+size_t BaxBatchReader::ReadNext(const size_t maxZmws, Columns* columns)
+{
+    // pick the batch's ZMWs, merging their base ranges into runs
+    columns->zmwIndices.clear();
+    columns->holeNumbers.clear();
+    columns->holeStatus.clear();
+    columns->offsets.assign(1, 0);
+    runs_.clear();
+    while (nextZmw_ < NumZmws() && columns->zmwIndices.size() < maxZmws) {
+        const size_t zmw = nextZmw_++;
+        if (!selected_.empty() && !selected_[zmw]) {
+            ++numZmwsSkipped_;
+            continue;
+        }
+        columns->zmwIndices.push_back(zmw);
+        columns->holeNumbers.push_back(holeNumbers_[zmw]);
+        columns->holeStatus.push_back(holeStatus_[zmw]);
+
+        const uint64_t begin = numEventOffsets_[zmw];
+        const uint64_t end   = numEventOffsets_[zmw+1];
+        if (end > begin) {
+            if (!runs_.empty() && runs_.back().end == begin)
+                runs_.back().end = end;
+            else
+                runs_.push_back(Run{ begin, end });
+        }
+        columns->offsets.push_back(columns->offsets.back() + (end - begin));
+    }
+
+    const size_t numZmws = columns->zmwIndices.size();
+    const uint64_t numBases = columns->offsets.back();
+    columns->numZmws = numZmws;
+    if (numZmws == 0)
+        return 0;
+
+    numJobs_ = 0;
+    try {
+        std::unique_lock<std::mutex> lock = internal::HdfLock(hdfMutex_);
+
+        if (includeHqRegionSnr_) {
+            // rows of the batch's ZMWs (16 bytes each), one slab per run of
+            // consecutive ZMWs, so sparse selections do not read the rows
+            // in between
+            H5::DataSpace fileSpace = hqRegionSnr_.getSpace();
+            for (size_t first = 0; first < numZmws; ) {
+                size_t last = first + 1;
+                while (last < numZmws && columns->zmwIndices[last] == columns->zmwIndices[last-1] + 1)
+                    ++last;
+                hsize_t count[2] = { last - first, 4 };
+                hsize_t start[2] = { columns->zmwIndices[first], 0 };
+                fileSpace.selectHyperslab(first == 0 ? H5S_SELECT_SET : H5S_SELECT_OR, count, start);
+                first = last;
+            }
+            std::vector<float>& rows = snrRows_;
+            rows.resize(numZmws * 4);
+            hsize_t count[2] = { numZmws, 4 };
+            const H5::DataSpace memorySpace(2, count);
+            hqRegionSnr_.read(rows.data(), H5::PredType::NATIVE_FLOAT, memorySpace, fileSpace);
+
+            // reorder to 'ACGT'
+            columns->hqRegionSnr.resize(numZmws * 4);
+            for (size_t i = 0; i < numZmws; ++i) {
+                const float* row = rows.data() + i*4;
+                for (size_t j = 0; j < 4; ++j)
+                    columns->hqRegionSnr[i*4 + j] = row[snrChannel_[j]];
+            }
+        } else
+            columns->hqRegionSnr.clear();
+
+        // one read (or a series of raw chunk reads) per field
+        ReadRuns(basecall_,        numBases, &columns->basecall,         H5::PredType::NATIVE_UCHAR);
+        ReadRuns(deletionQV_,      numBases, &columns->deletionQV,       H5::PredType::NATIVE_UCHAR);
+        ReadRuns(deletionTag_,     numBases, &columns->deletionTag,      H5::PredType::NATIVE_UCHAR);
+        ReadRuns(insertionQV_,     numBases, &columns->insertionQV,      H5::PredType::NATIVE_UCHAR);
+        ReadRuns(mergeQV_,         numBases, &columns->mergeQV,          H5::PredType::NATIVE_UCHAR);
+        ReadRuns(substitutionQV_,  numBases, &columns->substitutionQV,   H5::PredType::NATIVE_UCHAR);
+        ReadRuns(substitutionTag_, numBases, &columns->substitutionTag,  H5::PredType::NATIVE_UCHAR);
+        ReadRuns(preBaseFrames_,   numBases, &columns->preBaseFrames,    H5::PredType::NATIVE_UINT16);
+        ReadRuns(widthInFrames_,   numBases, &columns->widthInFrames,    H5::PredType::NATIVE_UINT16);
+
+    } catch (H5::Exception& e) {
+        throw std::runtime_error("could not read BaseCalls: "+e.getDetailMsg());
+    }
+
+    // inflate raw chunks, outside of HDF5
+    if (inflatePool_)
+        inflatePool_->Run(numJobs_, [this](size_t i) { InflateChunk(&jobs_[i]); });
+    else {
+        for (size_t i = 0; i < numJobs_; ++i)
+            InflateChunk(&jobs_[i]);
+    }
+
+    // keep each field's last chunk, the next batch is likely to start in it
+    for (size_t i = 0; i < numJobs_; ++i) {
+        ChunkJob& job = jobs_[i];
+        if (!job.error.empty()) {
+            job.field->cachedChunk = NoChunk;
+            throw std::runtime_error("could not read BaseCalls/"+job.field->name+": "+job.error);
+        }
+        job.field->cachedChunk = job.chunk;
+        job.field->cachedData.swap(job.inflated);
+    }
+
+    return numZmws;
+}
+
+void BaxBatchReader::View(Columns& columns, const size_t i, SMRTSequence* record)
+{
+    const uint64_t offset = columns.offsets[i];
+    const DNALength length = static_cast<DNALength>(columns.offsets[i+1] - offset);
+
+    // pointer into a column, or null if the field was not read
+    auto at = [offset](std::vector<unsigned char>& column) -> unsigned char* {
+        return column.empty() ? nullptr : column.data() + offset;
+    };
+    auto framesAt = [offset](std::vector<HalfWord>& column) -> HalfWord* {
+        return column.empty() ? nullptr : column.data() + offset;
+    };
+
+    // the record must never free column data
+    record->deleteOnExit = false;
+
+    record->zmwData.holeNumber = columns.holeNumbers[i];
+    record->zmwData.holeStatus = columns.holeStatus[i];
+    record->length = length;
+    record->seq = at(columns.basecall);
+    record->deletionQV.data     = at(columns.deletionQV);
+    record->deletionTag         = at(columns.deletionTag);
+    record->insertionQV.data    = at(columns.insertionQV);
+    record->mergeQV.data        = at(columns.mergeQV);
+    record->substitutionQV.data = at(columns.substitutionQV);
+    record->substitutionTag     = at(columns.substitutionTag);
+    record->qual.data           = nullptr;
+    record->preBaseFrames       = framesAt(columns.preBaseFrames);
+    record->widthInFrames       = framesAt(columns.widthInFrames);
+
+    if (!columns.hqRegionSnr.empty()) {
+        const float* snr = columns.hqRegionSnr.data() + i*4;
+        record->HQRegionSnr('A', snr[0])
+               .HQRegionSnr('C', snr[1])
+               .HQRegionSnr('G', snr[2])
+               .HQRegionSnr('T', snr[3]);
+    } else {
+        record->HQRegionSnr('A', 0).HQRegionSnr('C', 0).HQRegionSnr('G', 0).HQRegionSnr('T', 0);
+    }
+}
@@ -0,0 +1,228 @@
+#ifndef BAXBATCHREADER_H
+#define BAXBATCHREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <H5Cpp.h>
+
+#include <pbdata/SMRTSequence.hpp>
+
+class TaskPool;
+
+//
+// BaxBatchReader reads the BaseCalls of a BAX file a batch of consecutive
+// ZMWs at a time.
+//
+// ZMW offsets into the per-base datasets are computed once, from the
+// cumulative sum of ZMW/NumEvent, so each requested field of a batch is
+// fetched with a single contiguous hyperslab read (instead of one small read
+// per ZMW, per field, as HDFBasReader::GetNext does). The batch is stored
+// column-wise, and records are exposed as non-owning SMRTSequence views into
+// it.
+//
+// Fields stored as deflate-compressed (optionally shuffled) chunks are not
+// read through the HDF5 filter pipeline. Their raw chunks are fetched with
+// H5Dread_chunk() and inflated on a TaskPool, outside of HDF5 and its lock.
+// The last chunk of each field is kept, as the next batch starts in it.
+// Other fields, and chunks that cannot be read directly, use plain hyperslab
+// reads.
+//
+// Select() restricts reading to a subset of ZMWs. A batch is then made of
+// the next selected ZMWs, and each field is still fetched with a single read,
+// of the union of their base ranges.
+//
+// Field names are the same as HDFBasReader::IncludeField() takes.
+//
+// A reader is used by one thread at a time. HDF5 calls are made holding
+// 'hdfMutex' (if not null), which must be shared by all HDF5 users. Throws
+// std::runtime_error on failure.
+//
+class BaxBatchReader
+{
+public:
+    // A batch of ZMWs (in file order), column-wise. Containers keep their
+    // capacity across batches.
+    struct Columns
+    {
+        size_t numZmws;
+        std::vector<size_t> zmwIndices;     // index of each ZMW in the file
+        std::vector<uint64_t> offsets;      // numZmws + 1 base offsets, relative to the batch
+
+        std::vector<UInt> holeNumbers;
+        std::vector<unsigned char> holeStatus;
+        std::vector<float> hqRegionSnr;     // 4 per ZMW, in 'ACGT' order
+
+        std::vector<unsigned char> basecall;
+        std::vector<unsigned char> deletionQV;
+        std::vector<unsigned char> deletionTag;
+        std::vector<unsigned char> insertionQV;
+        std::vector<unsigned char> mergeQV;
+        std::vector<unsigned char> substitutionQV;
+        std::vector<unsigned char> substitutionTag;
+        std::vector<HalfWord> preBaseFrames;
+        std::vector<HalfWord> widthInFrames;
+
+        Columns(void) : numZmws(0) { }
+
+        // Size of the data read for the batch.
+        size_t NumBytes(void) const;
+    };
+
+public:
+    BaxBatchReader(const std::string& filename,
+                   const std::vector<std::string>& fields,
+                   const H5::FileAccPropList& fileAccess = H5::FileAccPropList::DEFAULT,
+                   std::mutex* hdfMutex = nullptr,
+                   TaskPool* inflatePool = nullptr);
+
+public:
+    size_t NumZmws(void) const { return numEventOffsets_.size() - 1; }
+
+    // ZMW 'i' of the file (read when the reader is created)
+    UInt HoleNumber(const size_t i) const { return holeNumbers_[i]; }
+    unsigned char HoleStatus(const size_t i) const { return holeStatus_[i]; }
+    size_t NumBases(const size_t i) const { return numEventOffsets_[i+1] - numEventOffsets_[i]; }
+    uint64_t BaseOffset(const size_t i) const { return numEventOffsets_[i]; }
+    uint64_t TotalNumBases(void) const { return numEventOffsets_.back(); }
+
+    // Reads only ZMWs 'i' with 'selected[i]' set from now on. Empty to read all.
+    void Select(const std::vector<bool>& selected);
+
+    // ZMWs passed over, as not selected
+    uint64_t NumZmwsSkipped(void) const { return numZmwsSkipped_; }
+
+    // Chunks of directly read fields served from the kept last chunk (hits),
+    // or read from the file (misses).
+    uint64_t NumChunkHits(void) const { return numChunkHits_; }
+    uint64_t NumChunkMisses(void) const { return numChunkMisses_; }
+
+    // Reads the next (up to) 'maxZmws' ZMWs into 'columns'. Returns the number
+    // of ZMWs read, 0 at end of file.
+    size_t ReadNext(const size_t maxZmws, Columns* columns);
+
+    // Points 'record' at ZMW 'i' of 'columns'. Nothing is copied, so 'record'
+    // is valid only until 'columns' is next filled.
+    static void View(Columns& columns, const size_t i, SMRTSequence* record);
+
+private:
+    struct BaseField
+    {
+        std::string name;
+        H5::DataSet dataset;
+        bool included;
+
+        // direct chunk reads
+        bool direct;
+        hsize_t chunkSize;                      // in elements
+        size_t elementSize;
+        bool shuffled;
+        unsigned deflateFilterBit;              // bit of the deflate filter in chunk filter masks
+        unsigned shuffleFilterBit;
+        hsize_t cachedChunk;                    // index of the chunk in 'cachedData', if any
+        std::vector<unsigned char> cachedData;
+
+        BaseField(void)
+            : included(false)
+            , direct(false)
+            , chunkSize(0)
+            , elementSize(0)
+            , shuffled(false)
+            , deflateFilterBit(0)
+            , shuffleFilterBit(0)
+            , cachedChunk(NoChunk)
+        { }
+    };
+
+    // a range of bases [begin, end) to read
+    struct Run
+    {
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    // elements [first, first+count) of a chunk, to copy to 'destination'
+    struct ChunkCopy
+    {
+        unsigned char* destination;
+        size_t first;
+        size_t count;
+    };
+
+    // one raw chunk to inflate into a batch column
+    struct ChunkJob
+    {
+        BaseField* field;
+        hsize_t chunk;
+        uint32_t filterMask;
+        std::vector<unsigned char> compressed;
+        std::vector<unsigned char> inflated;
+        std::vector<unsigned char> scratch;     // for un-shuffling
+        std::vector<ChunkCopy> copies;
+        std::string error;
+    };
+
+    static const hsize_t NoChunk = static_cast<hsize_t>(-1);
+
+    // Reads the bases of 'runs_' (numBases in all) of 'field' into 'data'.
+    template<typename T>
+    void ReadRuns(BaseField& field,
+                  const uint64_t numBases,
+                  std::vector<T>* data,
+                  const H5::PredType& type);
+
+    // Reads [begin, end) of 'runs' with one hyperslab read.
+    void ReadSlabs(BaseField& field,
+                   const Run* begin,
+                   const Run* end,
+                   void* data,
+                   const H5::PredType& type);
+
+    bool ReadRawChunk(BaseField& field, const hsize_t chunk, ChunkJob* job);
+
+    static void InflateChunk(ChunkJob* job);
+
+    void OpenField(const std::vector<std::string>& fields,
+                   const std::string& name,
+                   const H5::PredType& type,
+                   BaseField* field);
+
+private:
+    std::mutex* hdfMutex_;
+    TaskPool* inflatePool_;
+    std::vector<ChunkJob> jobs_;               // re-used, 'numJobs_' in use
+    size_t numJobs_;
+    uint64_t numChunkHits_;
+    uint64_t numChunkMisses_;
+
+    H5::H5File file_;
+    H5::Group baseCalls_;
+    size_t nextZmw_;
+    std::vector<bool> selected_;               // empty if all ZMWs are read
+    uint64_t numZmwsSkipped_;
+    std::vector<Run> runs_;                    // of the current batch
+
+    std::vector<uint64_t> numEventOffsets_;   // cumulative NumEvent, NumZmws() + 1 entries
+    std::vector<UInt> holeNumbers_;
+    std::vector<unsigned char> holeStatus_;
+
+    bool includeHqRegionSnr_;
+    H5::DataSet hqRegionSnr_;
+    int snrChannel_[4];                        // HQRegionSNR column of A, C, G, T
+    std::vector<float> snrRows_;               // re-used read buffer
+
+    BaseField basecall_;
+    BaseField deletionQV_;
+    BaseField deletionTag_;
+    BaseField insertionQV_;
+    BaseField mergeQV_;
+    BaseField substitutionQV_;
+    BaseField substitutionTag_;
+    BaseField preBaseFrames_;
+    BaseField widthInFrames_;
+};
+
+#endif // BAXBATCHREADER_H
@@ -0,0 +1,174 @@
+#include "BgzfConcat.h"
+
+#include <fstream>
+#include <stdexcept>
+
+#include <htslib/bgzf.h>
+#include <htslib/sam.h>
+
+const uint8_t BgzfConcat::EofBlock[28] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+    0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00
+};
+
+namespace internal {
+
+static inline
+uint32_t ReadLE(const char* data, const size_t numBytes)
+{
+    uint32_t result = 0;
+    for (size_t i = 0; i < numBytes; ++i)
+        result |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << (8*i);
+    return result;
+}
+
+// Returns the uncompressed length of a BAM file's header section.
+static
+int64_t BamHeaderLength(const std::string& fn)
+{
+    BGZF* fp = bgzf_open(fn.c_str(), "r");
+    if (fp == nullptr)
+        throw std::runtime_error("could not open "+fn);
+
+    bam_hdr_t* header = bam_hdr_read(fp);
+    const int64_t length = bgzf_utell(fp);
+    if (header)
+        bam_hdr_destroy(header);
+    bgzf_close(fp);
+
+    if (header == nullptr || length < 0)
+        throw std::runtime_error("could not read BAM header from "+fn);
+    return length;
+}
+
+// Reads the next raw BGZF block (gzip header, compressed data & trailer).
+// Returns false at end of file.
+static
+bool ReadBlock(std::ifstream& in,
+               const std::string& fn,
+               std::vector<char>* block,
+               uint32_t* uncompressedSize)
+{
+    // fixed gzip header, up to & including XLEN
+    static const size_t FixedHeaderLength = 12;
+    block->resize(FixedHeaderLength);
+    in.read(block->data(), FixedHeaderLength);
+    if (in.gcount() == 0)
+        return false;
+    if (static_cast<size_t>(in.gcount()) != FixedHeaderLength ||
+        static_cast<uint8_t>((*block)[0]) != 31  ||
+        static_cast<uint8_t>((*block)[1]) != 139 ||
+        ((*block)[3] & 4) == 0)
+    {
+        throw std::runtime_error("invalid BGZF block in "+fn);
+    }
+
+    // find total block size in the 'BC' extra subfield
+    const size_t extraLength = ReadLE(block->data() + 10, 2);
+    block->resize(FixedHeaderLength + extraLength);
+    in.read(block->data() + FixedHeaderLength, extraLength);
+    if (static_cast<size_t>(in.gcount()) != extraLength)
+        throw std::runtime_error("truncated BGZF block in "+fn);
+
+    size_t blockSize = 0;
+    for (size_t i = FixedHeaderLength; i + 4 <= block->size(); ) {
+        const char* subfield = block->data() + i;
+        const size_t subfieldLength = ReadLE(subfield + 2, 2);
+        if (subfield[0] == 'B' && subfield[1] == 'C' && subfieldLength == 2) {
+            blockSize = ReadLE(subfield + 4, 2) + 1;
+            break;
+        }
+        i += 4 + subfieldLength;
+    }
+    if (blockSize < block->size() + 8)
+        throw std::runtime_error("invalid BGZF block in "+fn);
+
+    // remainder of block
+    const size_t headerLength = block->size();
+    block->resize(blockSize);
+    in.read(block->data() + headerLength, blockSize - headerLength);
+    if (static_cast<size_t>(in.gcount()) != blockSize - headerLength)
+        throw std::runtime_error("truncated BGZF block in "+fn);
+
+    *uncompressedSize = ReadLE(block->data() + blockSize - 4, 4);
+    return true;
+}
+
+} // namespace internal
+
+std::vector<BgzfConcat::Segment> BgzfConcat::Concatenate(const std::vector<std::string>& inputFilenames,
+                                                         const std::string& outputFilename)
+{
+    if (inputFilenames.empty())
+        throw std::runtime_error("no input files to concatenate into "+outputFilename);
+
+    std::ofstream out(outputFilename, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("could not open "+outputFilename+" for writing");
+
+    std::vector<Segment> segments;
+    std::vector<char> block;
+    uint32_t uncompressedSize = 0;
+    int64_t outputOffset = 0;
+    for (size_t i = 0; i < inputFilenames.size(); ++i) {
+        const std::string& fn = inputFilenames.at(i);
+        int64_t headerRemaining = internal::BamHeaderLength(fn);
+
+        std::ifstream in(fn, std::ios::binary);
+        if (!in)
+            throw std::runtime_error("could not open "+fn);
+
+        int64_t inputOffset = 0;
+        std::vector<char> pendingEmptyBlocks;
+        while (internal::ReadBlock(in, fn, &block, &uncompressedSize)) {
+
+            // header blocks: keep only the first file's
+            if (headerRemaining > 0) {
+                headerRemaining -= uncompressedSize;
+                if (headerRemaining < 0)
+                    throw std::runtime_error("BAM header does not end on a BGZF block boundary in "+fn);
+                if (i == 0) {
+                    out.write(block.data(), block.size());
+                    outputOffset += block.size();
+                }
+                inputOffset += block.size();
+                if (headerRemaining == 0)
+                    segments.push_back(Segment{ inputOffset, outputOffset });
+                continue;
+            }
+
+            // Hold back empty blocks, dropping the trailing EOF marker. Any
+            // others are kept so that record blocks stay contiguous.
+            if (uncompressedSize == 0) {
+                pendingEmptyBlocks.insert(pendingEmptyBlocks.end(), block.cbegin(), block.cend());
+                continue;
+            }
+            if (!pendingEmptyBlocks.empty()) {
+                out.write(pendingEmptyBlocks.data(), pendingEmptyBlocks.size());
+                outputOffset += pendingEmptyBlocks.size();
+                pendingEmptyBlocks.clear();
+            }
+
+            out.write(block.data(), block.size());
+            outputOffset += block.size();
+        }
+
+        if (segments.size() != i + 1)
+            throw std::runtime_error("could not find end of BAM header in "+fn);
+    }
+
+    out.write(reinterpret_cast<const char*>(EofBlock), sizeof(EofBlock));
+    out.flush();
+    if (!out)
+        throw std::runtime_error("could not write to "+outputFilename);
+    return segments;
+}
+
+int64_t BgzfConcat::RebaseVirtualOffset(const int64_t virtualOffset,
+                                        const Segment& segment)
+{
+    const int64_t blockOffset = (virtualOffset >> 16) - segment.inputOffset + segment.outputOffset;
+    return (blockOffset << 16) | (virtualOffset & 0xFFFF);
+}
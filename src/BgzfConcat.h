@@ -0,0 +1,45 @@
+#ifndef BGZFCONCAT_H
+#define BGZFCONCAT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// BgzfConcat joins BAM files that share the same header, at the BGZF block
+// level.
+//
+// The header of the first input is written once, followed by the record
+// blocks of each input, in order, and a single EOF marker. Compressed blocks
+// are copied verbatim - nothing is decompressed or recompressed. This relies
+// on each input's header ending on a block boundary, which htslib (and so
+// pbbam's BamWriter) guarantees by flushing after writing the header.
+//
+// Throws std::runtime_error on failure.
+//
+class BgzfConcat
+{
+public:
+    // Where the record blocks of one input start, in that input and in the
+    // output. Record blocks are copied contiguously, so a virtual offset into
+    // the input is rebased by shifting its compressed part by
+    // (outputOffset - inputOffset).
+    struct Segment
+    {
+        int64_t inputOffset;
+        int64_t outputOffset;
+    };
+
+public:
+    static std::vector<Segment> Concatenate(const std::vector<std::string>& inputFilenames,
+                                            const std::string& outputFilename);
+
+    // Returns 'virtualOffset' (from the segment's input) rebased to the output.
+    static int64_t RebaseVirtualOffset(const int64_t virtualOffset,
+                                       const Segment& segment);
+
+    // the 28-byte empty block that terminates every BGZF file
+    static const uint8_t EofBlock[28];
+};
+
+#endif // BGZFCONCAT_H
@@ -26,74 +26,46 @@ CcsConverter::CcsConverter(Settings& settings)
 
 CcsConverter::~CcsConverter(void) { }
 
-bool CcsConverter::ConvertFile(HdfCcsReader* reader,
-                               BamWriter* writer)
+bool CcsConverter::ConvertZmw(const CCSSequence& smrtRecord,
+                              ConversionContext* context,
+                              RecordBuffer* records,
+                              RecordBuffer* scraps)
 {
-    assert(reader);
+    // Skip empty records
+    if ((smrtRecord.length == 0) || !IsSequencingZmw(smrtRecord))
+        return true;
 
-    // initialize read scores
-    InitReadScores(reader);
-
-    // fetch records from HDF5 file
-    CCSSequence smrtRecord;
-    while (reader->GetNext(smrtRecord)) {
-
-        // Skip empty records
-        if ((smrtRecord.length == 0) || !IsSequencingZmw(smrtRecord))
-            continue;
-
-        // attempt convert BAX to BAM
-        if (!WriteRecord(smrtRecord, 0, smrtRecord.length, ReadGroupId(), writer))
-        {
-            smrtRecord.Free();
-            return false;
-        }
-
-        smrtRecord.Free();
-    }
-
-    // if we get here, all OK
-    return true;
+    // attempt convert BAX to BAM
+    return WriteRecord(smrtRecord, 0, smrtRecord.length, ReadGroupId(), context, records);
 }
 
-bool CcsConverter::ConvertFile(HdfCcsReader* reader,
-                               PacBio::BAM::BamWriter* writer,
-                               PacBio::BAM::BamWriter* scrapsWriter)
-{ return false; }
-
-void CcsConverter::SetSequenceAndQualities(PacBio::BAM::BamRecordImpl* bamRecord,
+void CcsConverter::SetSequenceAndQualities(RawBamRecord* bamRecord,
                                            const CCSSequence& smrtRead,
                                            const int start,
-                                           const int length)
+                                           const int length,
+                                           ConversionContext* context)
 {
-    recordSequence_.assign((const char*)smrtRead.seq + start, length);
-    if (smrtRead.qual.Empty())
-        bamRecord->SetSequenceAndQualities(recordSequence_);
-    else
-    {
-        recordQVs_.assign((uint8_t*)smrtRead.qual.data + start,
-                          (uint8_t*)smrtRead.qual.data + start + length);
-        bamRecord->SetSequenceAndQualities(recordSequence_, recordQVs_.Fastq());
-    }
+    const uint8_t* qualities = nullptr;
+    if (!smrtRead.qual.Empty())
+        qualities = (uint8_t*)smrtRead.qual.data + start;
+    bamRecord->SetSequenceAndQualities((const char*)smrtRead.seq + start, length, qualities);
 }
 
-void CcsConverter::AddRecordName(PacBio::BAM::BamRecordImpl* bamRecord,
+void CcsConverter::AddRecordName(RawBamRecord* bamRecord,
                                  const UInt holeNumber,
                                  const int start,
                                  const int end)
 {
-    const std::string name = settings_.movieName + "/"
-                      + std::to_string(holeNumber) + "/ccs";
-    bamRecord->Name(name);
+    ReadName name(recordNamePrefix_);
+    name.Append(static_cast<uint32_t>(holeNumber)).Append("/ccs", 4);
+    bamRecord->Start(name.Data(), name.Size());
 }
 
-void CcsConverter::AddModeTags(PacBio::BAM::TagCollection* tags,
-                               const CCSSequence& smrtRead,
-                               const int start,
-                               const int end)
-{
-    (*tags)["np"] = static_cast<int32_t>(smrtRead.numPasses);
-}
+int32_t CcsConverter::NumPasses(const CCSSequence& smrtRead) const
+{ return static_cast<int32_t>(smrtRead.numPasses); }
+
+bool CcsConverter::HasQueryTags(void) const
+{ return false; }
 
 CcsConverter::HdfCcsReader* CcsConverter::InitHdfReader()
 {
@@ -18,31 +18,26 @@ public:
     ~CcsConverter(void);
 
 protected:
-    bool ConvertFile(HdfCcsReader* reader,
-                     PacBio::BAM::BamWriter* writer);
-    bool ConvertFile(HdfCcsReader* reader,
-                     PacBio::BAM::BamWriter* writer,
-                     PacBio::BAM::BamWriter* scrapsWriter);
-    void SetSequenceAndQualities(PacBio::BAM::BamRecordImpl* bamRecord,
+    bool ConvertZmw(const CCSSequence& smrtRecord,
+                    ConversionContext* context,
+                    RecordBuffer* records,
+                    RecordBuffer* scraps);
+    void SetSequenceAndQualities(RawBamRecord* bamRecord,
                                  const CCSSequence& smrtRecord,
                                  const int start,
-                                 const int end);
-    void AddRecordName(PacBio::BAM::BamRecordImpl* bamRecord,
+                                 const int end,
+                                 ConversionContext* context);
+    void AddRecordName(RawBamRecord* bamRecord,
                        const UInt holeNumber,
                        const int start,
                        const int end);
-    void AddModeTags(PacBio::BAM::TagCollection* tags,
-                     const CCSSequence& smrtRecord,
-                     const int start,
-                     const int end);
+    int32_t NumPasses(const CCSSequence& smrtRecord) const;
+    bool HasQueryTags(void) const;
     HdfCcsReader* InitHdfReader(void);
     std::string HeaderReadType(void) const;
     std::string ScrapsReadType(void) const;
     std::string OutputFileSuffix(void) const;
     std::string ScrapsFileSuffix(void) const;
-
-protected:
-    PacBio::BAM::QualityValues recordQVs_;
 };
 
 #endif // CCSCONVERTER_H
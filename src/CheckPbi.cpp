@@ -0,0 +1,165 @@
+//
+// bax2bam-check-pbi checks that the PBI indices bax2bam writes as it goes are
+// byte-for-byte those pbbam builds from the finished BAM files
+// (PbiFile::CreateFrom).
+//
+// Given the BAX files of one movie, it runs bax2bam in subread mode (main &
+// scraps BAM) and CCS mode, each with one thread and with enough threads to
+// convert parts concurrently, so the joined, rebased indices (PbiConcat) are
+// checked as well as those of single files.
+//
+// Exits non-zero, listing the mismatches, if any index differs.
+//
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <htslib/bgzf.h>
+
+#include <pbbam/BamFile.h>
+#include <pbbam/PbiFile.h>
+
+namespace internal {
+
+// one bax2bam run
+struct Conversion
+{
+    std::string name;
+    std::string modeOption;
+    std::vector<std::string> outputSuffixes;
+};
+
+// at 4 threads per part, up to 3 parts are converted concurrently
+static const int NumParallelThreads = 12;
+
+static std::string Quote(const std::string& s)
+{
+    std::string result = "'";
+    for (const char c : s) {
+        if (c == '\'')
+            result += "'\\''";
+        else
+            result += c;
+    }
+    return result + "'";
+}
+
+static std::string ReadFile(const std::string& fn)
+{
+    std::ifstream in(fn, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("could not open "+fn+" for reading");
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// uncompressed contents of a BGZF file
+static std::string InflateFile(const std::string& fn)
+{
+    BGZF* fp = bgzf_open(fn.c_str(), "r");
+    if (fp == nullptr)
+        throw std::runtime_error("could not open "+fn+" for reading");
+    std::string result;
+    char buffer[65536];
+    ssize_t n = 0;
+    while ((n = bgzf_read(fp, buffer, sizeof(buffer))) > 0)
+        result.append(buffer, n);
+    bgzf_close(fp);
+    if (n < 0)
+        throw std::runtime_error("could not read "+fn);
+    return result;
+}
+
+// Returns whether the inline index of 'bamFilename' matches pbbam's.
+static bool CheckIndex(const std::string& bamFilename)
+{
+    const std::string pbiFilename = bamFilename + ".pbi";
+    const std::string inlinePbi = ReadFile(pbiFilename);
+    const std::string inlineContents = InflateFile(pbiFilename);
+
+    // pbbam's index replaces ours
+    PacBio::BAM::PbiFile::CreateFrom(PacBio::BAM::BamFile{ bamFilename });
+    const std::string expectedPbi = ReadFile(pbiFilename);
+    if (inlinePbi == expectedPbi)
+        return true;
+
+    std::cerr << "MISMATCH: " << pbiFilename
+              << (inlineContents == InflateFile(pbiFilename) ? " (compressed bytes only)"
+                                                             : " (contents)")
+              << std::endl;
+    return false;
+}
+
+static bool Convert(const std::string& bax2bam,
+                    const Conversion& conversion,
+                    const int numThreads,
+                    const std::string& outputPrefix,
+                    const std::vector<std::string>& baxFilenames)
+{
+    std::string command = Quote(bax2bam) + " " + conversion.modeOption +
+                          " -j " + std::to_string(numThreads) +
+                          " -o " + Quote(outputPrefix);
+    for (const std::string& fn : baxFilenames)
+        command += " " + Quote(fn);
+
+    if (std::system(command.c_str()) != 0) {
+        std::cerr << "ERROR: conversion failed: " << command << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace internal
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4) {
+        std::cerr << "usage: bax2bam-check-pbi <bax2bam> <output dir> <BAX files of one movie>"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::string bax2bam = argv[1];
+    const std::string outputDir = argv[2];
+    const std::vector<std::string> baxFilenames(argv + 3, argv + argc);
+    if (baxFilenames.size() < 2)
+        std::cerr << "NOTE: parts are only joined given 2 or more BAX files" << std::endl;
+
+    const std::vector<internal::Conversion> conversions = {
+        { "subreads", "--subread", { ".subreads.bam", ".scraps.bam" } },
+        { "ccs",      "--ccs",     { ".ccs.bam" } }
+    };
+
+    size_t numFailures = 0;
+    size_t numChecked = 0;
+    try {
+        for (const internal::Conversion& conversion : conversions) {
+            for (const int numThreads : { 1, internal::NumParallelThreads }) {
+                const std::string outputPrefix = outputDir + "/check-pbi-" + conversion.name +
+                                                 "-j" + std::to_string(numThreads);
+                if (!internal::Convert(bax2bam, conversion, numThreads, outputPrefix, baxFilenames)) {
+                    ++numFailures;
+                    continue;
+                }
+                for (const std::string& suffix : conversion.outputSuffixes) {
+                    if (!internal::CheckIndex(outputPrefix + suffix))
+                        ++numFailures;
+                    ++numChecked;
+                }
+            }
+        }
+    } catch (std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (numFailures > 0) {
+        std::cerr << numFailures << " failures" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << numChecked << " inline PBI indices match pbbam's" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+//
+// bax2bam-check-pbi-writer checks, without any BAX input, that the PBI indices
+// RawBamWriter builds as it writes, and those PbiConcat joins, are
+// byte-for-byte those pbbam builds from the finished BAM files
+// (PbiFile::CreateFrom).
+//
+// Synthetic subreads are written to 3 parts (the middle one empty), with &
+// without a thread pool, then joined with BgzfConcat & PbiConcat. Some reads
+// are longer than a BGZF block, so records span blocks as well as share them.
+//
+// Exits non-zero, listing the mismatches, if any index differs.
+//
+
+#include "BgzfConcat.h"
+#include "PbiConcat.h"
+#include "RawBamRecord.h"
+#include "RawBamWriter.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <htslib/bgzf.h>
+#include <htslib/thread_pool.h>
+
+#include <pbbam/BamFile.h>
+#include <pbbam/BamHeader.h>
+#include <pbbam/PbiFile.h>
+#include <pbbam/ReadGroupInfo.h>
+
+namespace internal {
+
+static const std::string MovieName = "m140905_042212_sidney_c100564852550000001823085912221377_s1_X0";
+
+// ZMWs per non-empty part, & subreads per ZMW
+static const int NumZmws = 150;
+static const int MaxSubreads = 4;
+
+// subreads are mostly short, 1 in 50 is longer than a BGZF block
+static const int MaxShortLength = 4000;
+static const int LongLength = 70000;
+
+static const int NumPoolThreads = 4;
+
+static std::string ReadFile(const std::string& fn)
+{
+    std::ifstream in(fn, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("could not open "+fn+" for reading");
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// uncompressed contents of a BGZF file
+static std::string InflateFile(const std::string& fn)
+{
+    BGZF* fp = bgzf_open(fn.c_str(), "r");
+    if (fp == nullptr)
+        throw std::runtime_error("could not open "+fn+" for reading");
+    std::string result;
+    char buffer[65536];
+    ssize_t n = 0;
+    while ((n = bgzf_read(fp, buffer, sizeof(buffer))) > 0)
+        result.append(buffer, n);
+    bgzf_close(fp);
+    if (n < 0)
+        throw std::runtime_error("could not read "+fn);
+    return result;
+}
+
+// Returns whether the index of 'bamFilename' matches pbbam's.
+static bool CheckIndex(const std::string& bamFilename)
+{
+    const std::string pbiFilename = bamFilename + ".pbi";
+    const std::string inlinePbi = ReadFile(pbiFilename);
+    const std::string inlineContents = InflateFile(pbiFilename);
+
+    // pbbam's index replaces ours
+    PacBio::BAM::PbiFile::CreateFrom(PacBio::BAM::BamFile{ bamFilename });
+    const std::string expectedPbi = ReadFile(pbiFilename);
+    if (inlinePbi == expectedPbi)
+        return true;
+
+    std::cerr << "MISMATCH: " << pbiFilename
+              << (inlineContents == InflateFile(pbiFilename) ? " (compressed bytes only)"
+                                                             : " (contents)")
+              << std::endl;
+    return false;
+}
+
+// Writes subreads of ZMWs [firstHoleNumber, firstHoleNumber + numZmws).
+static void WritePart(const std::string& fn,
+                      const PacBio::BAM::BamHeader& header,
+                      const std::string& rgId,
+                      hts_tpool* threadPool,
+                      const int firstHoleNumber,
+                      const int numZmws,
+                      std::mt19937& random)
+{
+    static const char Bases[] = "ACGT";
+    std::uniform_int_distribution<int> numSubreads(1, MaxSubreads);
+    std::uniform_int_distribution<int> shortLength(1, MaxShortLength);
+    std::uniform_int_distribution<int> isLong(0, 49);
+    std::uniform_int_distribution<int> base(0, 3);
+    std::uniform_int_distribution<int> qv(0, 100);
+    std::uniform_int_distribution<int> cx(0, 15);
+    std::uniform_real_distribution<float> rq(0.75f, 1.0f);
+
+    RawBamWriter writer(fn, header, threadPool, 1);
+    RawBamRecord record;
+    std::string sequence;
+    std::vector<uint8_t> qvs;
+    for (int holeNumber = firstHoleNumber; holeNumber < firstHoleNumber + numZmws; ++holeNumber) {
+        const float readQual = rq(random);
+        int qStart = 0;
+        for (int i = numSubreads(random); i > 0; --i) {
+            const int length = (isLong(random) == 0 ? LongLength : shortLength(random));
+            const int qEnd = qStart + length;
+            sequence.resize(length);
+            qvs.resize(length);
+            for (int j = 0; j < length; ++j) {
+                sequence[j] = Bases[base(random)];
+                qvs[j] = static_cast<uint8_t>(qv(random));
+            }
+            const uint8_t contextFlags = static_cast<uint8_t>(cx(random));
+
+            record.Start(MovieName + "/" + std::to_string(holeNumber) + "/" +
+                         std::to_string(qStart) + "_" + std::to_string(qEnd));
+            record.SetSequenceAndQualities(sequence.data(), sequence.size(), qvs.data());
+            record.AddStringTag("RG", rgId);
+            record.AddUInt8Tag("cx", contextFlags);
+            record.AddInt32Tag("qe", qEnd);
+            record.AddInt32Tag("qs", qStart);
+            record.AddFloatTag("rq", readQual);
+            record.AddInt32Tag("zm", holeNumber);
+
+            record.pbi.rgId       = static_cast<int32_t>(std::stoul(rgId, nullptr, 16));
+            record.pbi.qStart     = qStart;
+            record.pbi.qEnd       = qEnd;
+            record.pbi.holeNumber = holeNumber;
+            record.pbi.readQual   = readQual;
+            record.pbi.ctxtFlag   = contextFlags;
+            writer.Write(record);
+
+            qStart = qEnd + 50;     // adapter
+        }
+    }
+    writer.Close();
+}
+
+// Writes & joins 3 parts, returning the number of indices that differ from
+// pbbam's (of 4).
+static size_t CheckParts(const std::string& outputPrefix,
+                         hts_tpool* threadPool,
+                         std::mt19937& random)
+{
+    using namespace PacBio::BAM;
+
+    ReadGroupInfo rg(MovieName, "SUBREAD");
+    rg.BindingKit("100356300")
+      .SequencingKit("100356200")
+      .BasecallerVersion("2.3.0.0.140018")
+      .FrameRateHz("75.000000");
+    BamHeader header;
+    header.AddReadGroup(rg);
+
+    const std::vector<std::string> partFilenames = {
+        outputPrefix + ".0.bam", outputPrefix + ".1.bam", outputPrefix + ".2.bam"
+    };
+    const int numZmws[] = { NumZmws, 0, NumZmws };
+    std::vector<std::string> partPbiFilenames;
+    int holeNumber = 0;
+    for (size_t i = 0; i < partFilenames.size(); ++i) {
+        WritePart(partFilenames.at(i), header, rg.Id(), threadPool, holeNumber, numZmws[i], random);
+        partPbiFilenames.push_back(partFilenames.at(i) + ".pbi");
+        holeNumber += numZmws[i];
+    }
+
+    const std::string joinedFilename = outputPrefix + ".bam";
+    const std::vector<BgzfConcat::Segment> segments =
+        BgzfConcat::Concatenate(partFilenames, joinedFilename);
+    PbiConcat::Concatenate(partPbiFilenames, segments, joinedFilename + ".pbi");
+
+    size_t numFailures = 0;
+    for (const std::string& fn : { partFilenames.at(0), partFilenames.at(1), partFilenames.at(2), joinedFilename }) {
+        if (!CheckIndex(fn))
+            ++numFailures;
+    }
+    return numFailures;
+}
+
+} // namespace internal
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        std::cerr << "usage: bax2bam-check-pbi-writer <output dir>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::string outputDir = argv[1];
+
+    size_t numFailures = 0;
+    hts_tpool* threadPool = nullptr;
+    try {
+        std::mt19937 random(42);
+        numFailures += internal::CheckParts(outputDir + "/check-pbi-writer-serial", nullptr, random);
+
+        threadPool = hts_tpool_init(internal::NumPoolThreads);
+        if (threadPool == nullptr)
+            throw std::runtime_error("could not start thread pool");
+        numFailures += internal::CheckParts(outputDir + "/check-pbi-writer-pooled", threadPool, random);
+        hts_tpool_destroy(threadPool);
+        threadPool = nullptr;
+    } catch (std::exception& e) {
+        if (threadPool)
+            hts_tpool_destroy(threadPool);
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (numFailures > 0) {
+        std::cerr << numFailures << " failures" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "8 written & joined PBI indices match pbbam's" << std::endl;
+    return EXIT_SUCCESS;
+}
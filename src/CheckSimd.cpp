@@ -0,0 +1,246 @@
+//
+// bax2bam-check-simd checks the vectorized encoders against their scalar
+// code, and against pbbam:
+//
+//   FramesEncoder (AVX2 gather)    vs scalar lookup vs Frames::Encode
+//   RawBamRecord bases (SSSE3)     vs scalar lookup vs htslib's bam_set1 &
+//     & QVs (AVX2, SSE2)             BamRecordImpl's sequence & qualities
+//
+// Exits non-zero, listing the mismatches, if any output differs.
+//
+
+#include "FramesEncoder.h"
+#include "RawBamRecord.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <htslib/sam.h>
+
+#include <pbbam/BamRecord.h>
+#include <pbbam/Frames.h>
+
+namespace internal {
+
+// around each vector width (16 frames, 16 bases, 16 & 32 QVs), with odd tails
+static const size_t Lengths[] = { 0, 1, 2, 7, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 255, 1001 };
+
+// l_read_name a multiple of 4, so bam_set1 adds no padding
+static const std::string RecordName = "m0/1/0_";
+
+// bytes of a record, after block_size
+static const size_t CoreLength = 32;
+
+static size_t NumFailures = 0;
+
+static void Fail(const std::string& what, const size_t length)
+{
+    if (NumFailures < 20)
+        std::cerr << "MISMATCH: " << what << " (length " << length << ")" << std::endl;
+    ++NumFailures;
+}
+
+static std::vector<uint8_t> EncodeFrames(const FramesEncoder& encoder,
+                                         const std::vector<uint16_t>& frames)
+{
+    std::vector<uint8_t> codes(frames.size());
+    encoder.Encode(frames.data(), frames.size(), codes.data());
+    return codes;
+}
+
+static void CheckFrames(const FramesEncoder& simd,
+                        const FramesEncoder& scalar,
+                        const std::vector<uint16_t>& frames,
+                        const std::string& label)
+{
+    const std::vector<uint8_t> expected = PacBio::BAM::Frames::Encode(frames);
+    if (EncodeFrames(scalar, frames) != expected)
+        Fail("frames, scalar vs pbbam: "+label, frames.size());
+    if (EncodeFrames(simd, frames) != expected)
+        Fail("frames, SIMD vs pbbam: "+label, frames.size());
+}
+
+static void CheckFramesEncoder(std::mt19937& random)
+{
+    const FramesEncoder simd;
+    const FramesEncoder scalar(false);
+
+    // every frame value: each codec boundary, the last framepoint & the
+    // saturated range above it
+    std::vector<uint16_t> frames(UINT16_MAX + 1);
+    for (size_t i = 0; i < frames.size(); ++i)
+        frames[i] = static_cast<uint16_t>(i);
+    CheckFrames(simd, scalar, frames, "all values");
+
+    // framepoints, and the frames either side of them, in every lane
+    const std::vector<uint8_t> allCodes = EncodeFrames(scalar, frames);
+    std::vector<uint16_t> boundaries;
+    for (size_t f = 1; f < allCodes.size(); ++f) {
+        if (allCodes[f] != allCodes[f-1]) {
+            boundaries.push_back(static_cast<uint16_t>(f - 1));
+            boundaries.push_back(static_cast<uint16_t>(f));
+            if (f + 1 < allCodes.size())
+                boundaries.push_back(static_cast<uint16_t>(f + 1));
+        }
+    }
+    boundaries.push_back(UINT16_MAX);
+    for (size_t shift = 0; shift < 16; ++shift) {
+        std::vector<uint16_t> shifted(shift, 0);
+        shifted.insert(shifted.end(), boundaries.cbegin(), boundaries.cend());
+        CheckFrames(simd, scalar, shifted, "codec boundaries, shifted by "+std::to_string(shift));
+    }
+
+    // vector tails: mostly small frames, some past the last framepoint
+    std::uniform_int_distribution<int> small(0, 1500);
+    std::uniform_int_distribution<int> any(0, UINT16_MAX);
+    for (const size_t length : Lengths) {
+        for (int trial = 0; trial < 8; ++trial) {
+            std::vector<uint16_t> values(length);
+            for (uint16_t& v : values)
+                v = static_cast<uint16_t>(trial % 2 == 0 ? small(random) : any(random));
+            CheckFrames(simd, scalar, values, "random");
+        }
+    }
+}
+
+static std::vector<uint8_t> EncodeRecord(const RawBamRecord::SimdLevel level,
+                                         const std::string& sequence,
+                                         const std::vector<uint8_t>* qvs)
+{
+    RawBamRecord::LimitSimd(level);
+    RawBamRecord record;
+    record.Start(RecordName);
+    record.SetSequenceAndQualities(sequence.data(), sequence.size(),
+                                   qvs ? qvs->data() : nullptr);
+    if (qvs)
+        record.AddQvTag("dq", qvs->data(), qvs->size());
+    RawBamRecord::LimitSimd(RawBamRecord::Avx2);
+    return std::vector<uint8_t>(record.Data(), record.Data() + record.Size());
+}
+
+static void CheckRecord(const std::string& sequence,
+                        const std::vector<uint8_t>* qvs,
+                        const std::string& label)
+{
+    const size_t length = sequence.size();
+    const std::vector<uint8_t> scalar = EncodeRecord(RawBamRecord::NoSimd, sequence, qvs);
+    if (EncodeRecord(RawBamRecord::Sse, sequence, qvs) != scalar)
+        Fail("record, SSE vs scalar: "+label, length);
+    if (EncodeRecord(RawBamRecord::Avx2, sequence, qvs) != scalar)
+        Fail("record, AVX2 vs scalar: "+label, length);
+
+    // name, packed bases & qualities, then the dq tag
+    const uint8_t* name = scalar.data() + 4 + CoreLength;
+    const uint8_t* packed = name + RecordName.size() + 1;
+    const uint8_t* quals = packed + (length + 1) / 2;
+    const uint8_t* tag = quals + length;
+    if (scalar.size() != static_cast<size_t>(tag - scalar.data()) + (qvs ? 3 + length + 1 : 0)) {
+        Fail("record size: "+label, length);
+        return;
+    }
+
+    // htslib, given the same (clamped) qualities
+    PacBio::BAM::QualityValues pbQvs;
+    if (qvs)
+        pbQvs.assign(qvs->cbegin(), qvs->cend());
+    std::vector<uint8_t> clamped(pbQvs.cbegin(), pbQvs.cend());
+    bam1_t* expected = bam_init1();
+    if (bam_set1(expected, RecordName.size(), RecordName.c_str(), 4, -1, -1, 255, 0, nullptr,
+                 -1, -1, 0, length, sequence.data(),
+                 qvs ? reinterpret_cast<const char*>(clamped.data()) : nullptr, 0) < 0) {
+        bam_destroy1(expected);
+        throw std::runtime_error("could not encode record with htslib");
+    }
+    const size_t expectedLength = static_cast<size_t>(expected->l_data);
+    if (expectedLength != static_cast<size_t>(tag - name) ||
+        !std::equal(name, tag, expected->data))
+    {
+        Fail("record vs htslib: "+label, length);
+    }
+    bam_destroy1(expected);
+
+    // pbbam, reading back what it stores
+    PacBio::BAM::BamRecordImpl impl;
+    impl.SetSequenceAndQualities(sequence, qvs ? pbQvs.Fastq() : std::string());
+    std::string bases(length, ' ');
+    for (size_t i = 0; i < length; ++i)
+        bases[i] = seq_nt16_str[(packed[i/2] >> (i % 2 == 0 ? 4 : 0)) & 0x0F];
+    if (bases != impl.Sequence())
+        Fail("bases vs pbbam: "+label, length);
+    if (qvs) {
+        std::string fastq(length, ' ');
+        for (size_t i = 0; i < length; ++i)
+            fastq[i] = static_cast<char>(quals[i] + 33);
+        if (fastq != impl.Qualities().Fastq())
+            Fail("qualities vs pbbam: "+label, length);
+        if (std::string(reinterpret_cast<const char*>(tag + 3), length) != pbQvs.Fastq())
+            Fail("QV tag vs pbbam: "+label, length);
+    }
+}
+
+static void CheckRawBamRecord(std::mt19937& random)
+{
+    // bases: the fast path (A,C,G,T,N in either case), with the odd other
+    // code (IUPAC, '=', ...) sending a block to the scalar path
+    const std::string fastBases = "ACGTNacgtn";
+    const std::string otherBases = "RYKMSWBDHVU=.*-";
+    std::uniform_int_distribution<size_t> fast(0, fastBases.size() - 1);
+    std::uniform_int_distribution<size_t> other(0, otherBases.size() - 1);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::uniform_int_distribution<int> qv(0, UINT8_MAX);
+
+    for (const size_t length : Lengths) {
+        for (int trial = 0; trial < 8; ++trial) {
+            std::string sequence(length, ' ');
+            for (char& base : sequence)
+                base = (trial >= 4 && percent(random) < 3 ? otherBases[other(random)]
+                                                          : fastBases[fast(random)]);
+            std::vector<uint8_t> qvs(length);
+            for (uint8_t& q : qvs)
+                q = static_cast<uint8_t>(qv(random));
+            CheckRecord(sequence, &qvs, "random");
+            CheckRecord(sequence, nullptr, "random, no qualities");
+        }
+    }
+
+    // every byte as a base, and every QV, in every lane
+    for (size_t shift = 0; shift < 32; ++shift) {
+        std::string sequence(shift, 'A');
+        std::vector<uint8_t> qvs(shift, 0);
+        for (int value = 0; value <= UINT8_MAX; ++value) {
+            sequence.push_back(static_cast<char>(value));
+            qvs.push_back(static_cast<uint8_t>(value));
+        }
+        CheckRecord(sequence, &qvs, "all values, shifted by "+std::to_string(shift));
+    }
+}
+
+} // namespace internal
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    std::mt19937 random(42);
+    try {
+        internal::CheckFramesEncoder(random);
+        internal::CheckRawBamRecord(random);
+    } catch (std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (internal::NumFailures > 0) {
+        std::cerr << internal::NumFailures << " mismatches" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "SIMD encoders match the scalar code & pbbam" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+#include "ChunkCache.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace internal {
+
+static const size_t MaxSlots = 1 << 16;     // slot tables are 8 bytes per slot, per dataset
+
+static bool IsPrime(const size_t n)
+{
+    if (n < 2)
+        return false;
+    for (size_t d = 2; d * d <= n; ++d) {
+        if (n % d == 0)
+            return false;
+    }
+    return true;
+}
+
+// HDF5 hashes chunks into slots, a prime count spreads them best
+static size_t NextPrime(size_t n)
+{
+    while (!IsPrime(n))
+        ++n;
+    return n;
+}
+
+} // namespace internal
+
+ChunkCacheConfig::ChunkCacheConfig(void)
+    : numDatasets(0)
+    , largestChunkBytes(0)
+    , bytesPerDataset(0)
+    , numSlots(0)
+{ }
+
+ChunkCacheConfig ChunkCacheConfig::ForFile(const std::string& filename,
+                                           const std::string& group,
+                                           const std::vector<std::string>& fields,
+                                           const size_t totalMB)
+{
+    ChunkCacheConfig config;
+    size_t smallestChunkBytes = std::numeric_limits<size_t>::max();
+
+    try {
+        H5::H5File file(filename, H5F_ACC_RDONLY);
+        if (H5Lexists(file.getId(), group.c_str(), H5P_DEFAULT) <= 0)
+            return config;
+        const H5::Group baseCalls = file.openGroup(group);
+
+        for (const std::string& field : fields) {
+            if (H5Lexists(baseCalls.getId(), field.c_str(), H5P_DEFAULT) <= 0)
+                continue;
+            const H5::DataSet dataset = baseCalls.openDataSet(field);
+            const H5::DSetCreatPropList plist = dataset.getCreatePlist();
+            if (plist.getLayout() != H5D_CHUNKED)
+                continue;
+
+            const int rank = plist.getChunk(0, nullptr);
+            if (rank <= 0)
+                continue;
+            std::vector<hsize_t> chunkDims(rank);
+            plist.getChunk(rank, chunkDims.data());
+            size_t chunkBytes = dataset.getDataType().getSize();
+            for (const hsize_t dim : chunkDims)
+                chunkBytes *= dim;
+
+            ++config.numDatasets;
+            config.largestChunkBytes = std::max(config.largestChunkBytes, chunkBytes);
+            smallestChunkBytes = std::min(smallestChunkBytes, chunkBytes);
+        }
+    } catch (H5::Exception& e) {
+        throw std::runtime_error("could not read chunk layout of "+filename+": "+e.getDetailMsg());
+    }
+    if (config.numDatasets == 0)
+        return config;
+
+    if (totalMB > 0)
+        config.bytesPerDataset = (totalMB << 20) / config.numDatasets;
+    else
+        config.bytesPerDataset = std::max(static_cast<size_t>(MinBytesPerDataset), ChunksPerDataset * config.largestChunkBytes);
+
+    // ~100 slots per chunk that fits, as HDF5 recommends
+    const size_t numChunks = std::max(static_cast<size_t>(1), config.bytesPerDataset / smallestChunkBytes);
+    config.numSlots = internal::NextPrime(std::min(internal::MaxSlots, 100 * numChunks));
+    return config;
+}
+
+void ChunkCacheConfig::Apply(H5::FileAccPropList* fileAccess) const
+{
+    if (bytesPerDataset == 0)
+        return;
+
+    // reads are sequential, so fully read chunks go first
+    int metadataElements = 0;
+    size_t slots = 0;
+    size_t bytes = 0;
+    double w0 = 0.0;
+    fileAccess->getCache(metadataElements, slots, bytes, w0);
+    fileAccess->setCache(metadataElements, numSlots, bytesPerDataset, 1.0);
+}
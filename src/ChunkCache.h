@@ -0,0 +1,43 @@
+#ifndef CHUNKCACHE_H
+#define CHUNKCACHE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <H5Cpp.h>
+
+//
+// ChunkCacheConfig sizes HDF5's raw data chunk cache for BAX input.
+//
+// The cache is per dataset, and HDF5's default (1 MB, 521 slots) holds only a
+// chunk or two of the per-base datasets. As every ZMW read touches each
+// included field's dataset in turn, chunks are then evicted & inflated again
+// before being fully read. The automatic size instead holds a few of the
+// largest chunks of any included field.
+//
+struct ChunkCacheConfig
+{
+    static const size_t ChunksPerDataset = 4;
+    static const size_t MinBytesPerDataset = 1 << 20;
+
+    size_t numDatasets;         // included per-base datasets
+    size_t largestChunkBytes;
+    size_t bytesPerDataset;     // 0 to keep the HDF5 default
+    size_t numSlots;
+
+    ChunkCacheConfig(void);
+
+    // Sizes the cache for the 'fields' datasets in 'group' of BAX file
+    // 'filename'. If non-zero, 'totalMB' overrides the automatic size, and is
+    // split evenly across the datasets. Throws std::runtime_error on failure.
+    static ChunkCacheConfig ForFile(const std::string& filename,
+                                    const std::string& group,
+                                    const std::vector<std::string>& fields,
+                                    const size_t totalMB);
+
+    // Sets the cache on 'fileAccess', used to open input files.
+    void Apply(H5::FileAccPropList* fileAccess) const;
+};
+
+#endif // CHUNKCACHE_H
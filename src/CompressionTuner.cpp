@@ -0,0 +1,67 @@
+#include "CompressionTuner.h"
+
+#include <algorithm>
+
+namespace internal {
+
+// rate changes within this fraction are noise
+static const double Tolerance = 0.03;
+
+// windows to stay at a level after a probe that did not help
+static const int NumHoldWindows = 4;
+
+} // namespace internal
+
+CompressionTuner::CompressionTuner(const int initialLevel)
+    : level_(0)
+    , direction_(1)
+    , probed_(false)
+    , lastRate_(0.0)
+    , numHoldWindows_(0)
+{
+    level_ = Clamp(initialLevel);
+}
+
+int CompressionTuner::Clamp(const int level) const
+{
+    return std::min(std::max(level, static_cast<int>(MinLevel)), static_cast<int>(MaxLevel));
+}
+
+void CompressionTuner::Step(void)
+{
+    // turn back at either end
+    if (level_ + direction_ < MinLevel || level_ + direction_ > MaxLevel)
+        direction_ = -direction_;
+    level_ += direction_;
+    probed_ = true;
+}
+
+int CompressionTuner::EndWindow(const uint64_t numBytes, const double seconds)
+{
+    if (seconds <= 0.0)
+        return level_;
+    const double rate = numBytes / seconds;
+
+    if (probed_) {
+        // A step up is kept unless it lowered the rate: on a tie, smaller
+        // output wins. A step down must raise the rate to be kept.
+        const bool worse = (rate < lastRate_ * (1.0 - internal::Tolerance));
+        const bool better = (rate > lastRate_ * (1.0 + internal::Tolerance));
+        const bool kept = (direction_ > 0 ? !worse : better);
+        if (!kept) {
+            // undo it, then probe the other way
+            level_ -= direction_;
+            direction_ = -direction_;
+        }
+        probed_ = false;
+        numHoldWindows_ = (kept && better ? 0 : internal::NumHoldWindows);
+        if (numHoldWindows_ == 0)
+            Step();
+    } else if (numHoldWindows_ > 0) {
+        --numHoldWindows_;
+    } else {
+        Step();
+    }
+    lastRate_ = rate;
+    return level_;
+}
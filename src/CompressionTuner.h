@@ -0,0 +1,57 @@
+#ifndef COMPRESSIONTUNER_H
+#define COMPRESSIONTUNER_H
+
+#include <cstdint>
+
+//
+// CompressionTuner picks the deflate level of an output file as it is
+// written (--compression auto), to maximize its write rate.
+//
+// Output is measured in windows of about WindowBytes uncompressed bytes, each
+// ending as its last block is written, so a window's rate covers deflate, I/O
+// and everything upstream of the writer. A new level applies to blocks queued
+// after it is chosen, so the next window starts with a few (queued) blocks at
+// the old one. Where compression is the bottleneck, a lower level raises the
+// rate; where I/O is, a higher one does (fewer bytes to write). After each
+// window the level steps (by one) in the current direction. Rates within a
+// few percent are a tie, and ties go to the higher level, for smaller output:
+// a step up is kept unless the rate drops, a step down only if it rises. A
+// step that is undone, or that gains nothing, is followed by a few windows at
+// the same level before the next probe.
+//
+// The rate is uncompressed bytes per second, which tracks records per second
+// without depending on read lengths.
+//
+class CompressionTuner
+{
+public:
+    static const int MinLevel = 1;
+    static const int MaxLevel = 9;
+    static const uint64_t WindowBytes = 64 << 20;
+
+public:
+    // 'initialLevel' outside [MinLevel, MaxLevel] is clamped.
+    explicit CompressionTuner(const int initialLevel);
+
+public:
+    int Level(void) const { return level_; }
+
+    // Ends a window of 'numBytes' uncompressed bytes, written at Level() in
+    // 'seconds'. Returns the level for the next window.
+    int EndWindow(const uint64_t numBytes, const double seconds);
+
+private:
+    int Clamp(const int level) const;
+
+    // Moves one level in 'direction_' (turned around at either end).
+    void Step(void);
+
+private:
+    int level_;
+    int direction_;         // of the next probe, +1 or -1
+    bool probed_;           // whether the last window followed a step
+    double lastRate_;       // of the last window, 0 before the first
+    int numHoldWindows_;    // left before probing again
+};
+
+#endif // COMPRESSIONTUNER_H
@@ -3,37 +3,43 @@
 #ifndef CONVERTERBASE_H
 #define CONVERTERBASE_H
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <cstdlib>
 #include <climits>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 
-#include <pbbam/BamFile.h>
 #include <pbbam/BamHeader.h>
-#include <pbbam/BamWriter.h>
-#include <pbbam/PbiFile.h>
 #include <pbbam/ReadGroupInfo.h>
-#include <pbbam/Tag.h>
 
 #include <hdf/HDFBasReader.hpp>
 
 #include <libgen.h>
 
+#include "BaxBatchReader.h"
+#include "BgzfConcat.h"
+#include "ChunkCache.h"
+#include "FramesEncoder.h"
 #include "IConverter.h"
+#include "IntervalPlan.h"
+#include "OrderedPipeline.h"
+#include "PbiConcat.h"
+#include "RawBamRecord.h"
+#include "RawBamWriter.h"
+#include "ReadaheadFileDriver.h"
+#include "ReadName.h"
 #include "Settings.h"
-
-namespace PacBio {
-namespace BAM {
-
-class BamRecordImpl;
-
-} // namespace BAM
-} // namespace PacBio
+#include "TaskPool.h"
+#include "ZmwSelection.h"
 
 template<typename RecordType = SMRTSequence, typename HdfReader = HDFBasReader>
 class ConverterBase : public IConverter
@@ -44,79 +50,287 @@ public:
 public:
     virtual bool Run(void) final;
 
+protected:
+    // Output records for a batch of ZMWs. Record objects are re-used across
+    // batches, so steady-state conversion does not re-allocate them.
+    class RecordBuffer
+    {
+    public:
+        RecordBuffer(void) : size_(0) { }
+
+        RawBamRecord* Next(void)
+        {
+            if (size_ == records_.size())
+                records_.emplace_back();
+            return &records_[size_++];
+        }
+
+        void Clear(void) { size_ = 0; }
+        size_t Size(void) const { return size_; }
+        const RawBamRecord& operator[](const size_t i) const { return records_[i]; }
+
+    private:
+        std::vector<RawBamRecord> records_;
+        size_t size_;
+    };
+
+    // Read scores of one input file, indexed directly by hole number (hole
+    // numbers within a BAX file are dense & increasing). Hole numbers
+    // without a score get the file's first score, as before.
+    class ReadScoreTable
+    {
+    public:
+        ReadScoreTable(void) : firstHoleNumber_(0) { }
+
+        void Assign(const std::vector<UInt>& holeNumbers,
+                    const std::vector<float>& readScores)
+        {
+            scores_.clear();
+            firstHoleNumber_ = 0;
+            const size_t numScores = std::min(holeNumbers.size(), readScores.size());
+            if (numScores == 0)
+                return;
+
+            const auto range = std::minmax_element(holeNumbers.cbegin(), holeNumbers.cbegin() + numScores);
+            firstHoleNumber_ = *range.first;
+            scores_.assign(*range.second - firstHoleNumber_ + 1, readScores.front());
+            for (size_t i = 0; i < numScores; ++i)
+                scores_[holeNumbers[i] - firstHoleNumber_] = readScores[i];
+        }
+
+        float Score(const UInt holeNumber) const
+        {
+            if (scores_.empty())
+                return 0.0f;
+            const size_t index = holeNumber - firstHoleNumber_;
+            return (holeNumber >= firstHoleNumber_ && index < scores_.size() ? scores_[index]
+                                                                             : scores_.front());
+        }
+
+    private:
+        UInt firstHoleNumber_;
+        std::vector<float> scores_;
+    };
+
+    // How --threads is spent. Each file converted at once has a reader thread
+    // (unless reading in turn, on one thread) and the calling thread, which
+    // writes records out, and converts them itself without workers. What is
+    // left goes to conversion workers and to the pool shared by input
+    // inflation & output compression.
+    struct ThreadBudget
+    {
+        size_t numConcurrentFiles;
+        bool usingReader;
+        size_t numWorkersPerFile;
+        size_t numPoolThreads;
+    };
+
+    // Per-worker conversion state. Each worker thread owns one of these, so
+    // re-used containers are never shared between threads.
+    struct ConversionContext
+    {
+        size_t fileIndex;   // input file of the ZMWs being converted
+        float readScore;    // of the ZMW being converted
+        IntervalPlan intervals;
+
+        ConversionContext(void) : fileIndex(0), readScore(0.0f) { }
+    };
+
+    // A run of consecutive ZMWs read from one BAX file, along with the BAM
+    // records converted from them (in input order).
+    struct ZmwBatch
+    {
+        size_t fileIndex;
+        std::vector<RecordType> zmws;
+        size_t size;
+        BaxBatchReader::Columns columns;    // BaseCalls 'zmws' point into (if read in bulk)
+        RecordBuffer records;
+        RecordBuffer scraps;
+
+        ZmwBatch(void) : fileIndex(0), size(0) { }
+    };
+
+    // number of ZMWs per batch
+    static const size_t BatchSize = 64;
+
+    // What is known of a ZMW before its bases are read.
+    struct ZmwSummary
+    {
+        size_t fileIndex;
+        UInt holeNumber;
+        unsigned char holeStatus;
+        size_t readLength;
+    };
+
 protected:
     ConverterBase(Settings& settings);
 
+    // Loads any per-file data (region table, read scores, etc.) needed
+    // before the ZMWs of 'reader' can be converted. Called for every input
+    // file, in order, before any conversion starts.
+    virtual bool InitFile(HdfReader* reader, const size_t fileIndex);
+
+    // Picks the ZMWs that are read in bulk: those of this shard (if any), in
+    // the ZMW selection, passing the read filters, and writing any record.
+    // Called once all files are initialized.
+    virtual void SelectZmws(void) final;
+
+    // Whether the ZMW passes the ZMW-level read filters (--min-rq here).
+    // ZMWs that do not are neither read (if read in bulk) nor converted.
+    virtual bool PassesFilters(const ZmwSummary& zmw) const;
+
+    // Whether the ZMW is in the ZMW selection & passes the read filters.
+    // Counts filtered ZMWs, so is called once per ZMW.
+    virtual bool SelectsZmw(const ZmwSummary& zmw) final;
+
+    // Whether converting the ZMW would add any record to the output. ZMWs for
+    // which this is false are not read at all (if read in bulk). Called
+    // after InitFile() has loaded the file's data, once per ZMW.
+    virtual bool EmitsRecords(const ZmwSummary& zmw);
+
+    // Converts a single ZMW, adding its BAM records to 'records' and
+    // 'scraps' in output order. 'scraps' is null for single-output jobs.
+    virtual bool ConvertZmw(const RecordType& smrtRecord,
+                            ConversionContext* context,
+                            RecordBuffer* records,
+                            RecordBuffer* scraps) =0;
+
+    // Converts all input files into the main (and scraps) BAM file(s).
+    // Files are converted concurrently if multiple threads are available.
+    virtual bool ConvertFiles(const PacBio::BAM::BamHeader& header,
+                              const PacBio::BAM::BamHeader& scrapsHeader) final;
+
+    virtual bool ConvertFilesInParallel(const PacBio::BAM::BamHeader& header,
+                                        const PacBio::BAM::BamHeader& scrapsHeader) final;
+
+    // Splits 'numThreads' over the threads of converting 'numFiles' files,
+    // so that no more are started.
+    static ThreadBudget SplitThreads(const size_t numThreads,
+                                     const size_t numFiles,
+                                     const size_t prefetchDepth);
+
+    // Joins the BAM (and PBI) files of converted parts. Throws on failure.
+    virtual void ConcatenateParts(const std::vector<std::string>& partFilenames,
+                                  const std::string& outputFilename) final;
+
+    // Adds the deflate levels used by closed writers, and their compression
+    // & write times, to the output stats.
+    virtual void AddCompressionStats(const RawBamWriter& writer,
+                                     const RawBamWriter* scrapsWriter) final;
+
+    // Converts a single input file, with the threads of 'threadBudget_'.
+    // Reads run ahead of conversion (see Settings::prefetchDepth), with at
+    // most 'maxPrefetchBytes' of batches waiting (0 for no limit).
+    // 'scrapsWriter' is null for single-output jobs.
     virtual bool ConvertFile(HdfReader* reader,
-                             PacBio::BAM::BamWriter* writer) =0;
+                             const size_t fileIndex,
+                             const size_t maxPrefetchBytes,
+                             RawBamWriter* writer,
+                             RawBamWriter* scrapsWriter) final;
 
-    virtual bool ConvertFile(HdfReader* reader,
-                             PacBio::BAM::BamWriter* writer,
-                             PacBio::BAM::BamWriter* scrapsWriter) =0;
+    // Approximate memory held by the input data of a filled batch.
+    virtual size_t BatchInputBytes(const ZmwBatch& batch,
+                                   const size_t fieldsPerBase) const final;
+
+    virtual bool FillBatch(HdfReader* reader,
+                           const size_t fileIndex,
+                           ZmwBatch* batch);
+
+    virtual bool ConvertBatch(ZmwBatch* batch,
+                              ConversionContext* context,
+                              const bool hasScraps);
+
+    virtual bool WriteBatch(const ZmwBatch& batch,
+                            RawBamWriter* writer,
+                            RawBamWriter* scrapsWriter);
 
     virtual bool ConvertRecord(const RecordType& smrtRecord,
                                const int start,
                                const int end,
                                const std::string& rgId,
-                               PacBio::BAM::BamRecordImpl* bamRecord);
+                               ConversionContext* context,
+                               RawBamRecord* bamRecord);
 
     virtual bool WriteRecord(const RecordType& smrtRecord,
                              const int recordStart,
                              const int recordEnd,
                              const std::string& readGroupId,
-                             PacBio::BAM::BamWriter* writer);
+                             ConversionContext* context,
+                             RecordBuffer* output);
 
     virtual bool WriteFilteredRecord(const RecordType& smrtRecord,
                                      const int recordStart,
                                      const int recordEnd,
                                      const std::string& readGroupId,
-                                     PacBio::BAM::BamWriter* writer);
+                                     ConversionContext* context,
+                                     RecordBuffer* output);
 
     virtual bool WriteFilteredRecord(const RecordType& smrtRecord,
                                      const int recordStart,
                                      const int recordEnd,
                                      const std::string& readGroupId,
                                      const uint8_t contextFlags,
-                                     PacBio::BAM::BamWriter* writer);
+                                     ConversionContext* context,
+                                     RecordBuffer* output);
 
     virtual bool WriteLowQualityRecord(const RecordType& smrtRecord,
                                        const int recordStart,
                                        const int recordEnd,
                                        const std::string& readGroupId,
-                                       PacBio::BAM::BamWriter* writer);
+                                       ConversionContext* context,
+                                       RecordBuffer* output);
 
     virtual bool WriteAdapterRecord(const RecordType& smrtRecord,
                                     const int recordStart,
                                     const int recordEnd,
                                     const std::string& readGroupId,
-                                    PacBio::BAM::BamWriter* writer);
+                                    ConversionContext* context,
+                                    RecordBuffer* output);
 
     virtual bool WriteSubreadRecord(const RecordType& smrtRecord,
                                     const int recordStart,
                                     const int recordEnd,
                                     const std::string& readGroupId,
                                     const uint8_t contextFlags,
-                                    PacBio::BAM::BamWriter* writer);
+                                    ConversionContext* context,
+                                    RecordBuffer* output);
 
-    virtual void SetSequenceAndQualities(PacBio::BAM::BamRecordImpl* bamRecord,
+    virtual void SetSequenceAndQualities(RawBamRecord* bamRecord,
                                          const RecordType& smrtRecord,
                                          const int start,
-                                         const int length);
+                                         const int length,
+                                         ConversionContext* context);
 
-    virtual void AddRecordName(PacBio::BAM::BamRecordImpl* bamRecord,
+    // Starts a new record in 'bamRecord', with the read name for this ZMW
+    // & interval.
+    virtual void AddRecordName(RawBamRecord* bamRecord,
                                const UInt holeNumber,
                                const int start,
                                const int end);
 
-    virtual void AddModeTags(PacBio::BAM::TagCollection* tags,
-                             const RecordType& smrtRecord,
-                             const int start,
-                             const int end);
+    // Mode-specific tag values: number of passes (np), and whether the read
+    // stores its query start/end (qs/qe).
+    virtual int32_t NumPasses(const RecordType& smrtRecord) const;
+    virtual bool HasQueryTags(void) const;
 
     virtual HdfReader* InitHdfReader(void);
-    virtual void InitReadScores(HdfReader* reader) final;
+
+    // BaseCalls fields to read, as HDFBasReader::IncludeField() names.
+    virtual std::vector<std::string> BaseCallFields(void) const final;
+
+    // HDF5 group holding the BaseCallFields() datasets.
+    virtual std::string BaseCallsGroupName(void) const final;
+
+    // Whether ZMWs are read in bulk with BaxBatchReader. CCS reads come
+    // from a different group, through the HDF reader.
+    virtual bool UsesBatchReader(void) const;
+    virtual void InitReadScores(HdfReader* reader, const size_t fileIndex) final;
+
+    // Reads the hole numbers of all ZMWs in 'reader's file, in one read.
+    virtual void ReadHoleNumbers(HdfReader* reader, std::vector<UInt>* holeNumbers) final;
 
     virtual bool IsSequencingZmw(const RecordType& record) const final;
+    virtual bool IsSequencingZmw(const unsigned char holeStatus) const final;
 
     virtual bool LoadChemistryFromMetadataXML(const std::string& baxFn,
                                               const std::string& movieName) final;
@@ -133,29 +347,27 @@ protected:
 
 protected:
     std::vector<HdfReader*> readers_;
+    std::vector<std::unique_ptr<BaxBatchReader> > batchReaders_;   // per input file, if used
+    std::unique_ptr<TaskPool> threadPool_;                          // shared by batch readers & BAM writers
+    ThreadBudget threadBudget_;
+    H5::FileAccPropList fileAccess_;                                // used to open all input files
     std::map<HdfReader*, std::string> filenameForReader_;
 
-    std::vector<float> readScores_;
-    std::map<UInt, size_t> indexForHoleNumber_; // helper table for read scores (holenumber -> vector index)
-
-    // re-used containers
-    PacBio::BAM::BamRecordImpl bamRecord_;
-    std::string recordSequence_;
-    PacBio::BAM::QualityValues recordDeletionQVs_;
-    PacBio::BAM::QualityValues recordInsertionQVs_;
-    PacBio::BAM::QualityValues recordMergeQVs_;
-    PacBio::BAM::QualityValues recordSubstitutionQVs_;
-    std::string recordDeletionTags_;
-    std::string recordSubstitutionTags_;
-    std::vector<uint16_t> recordRawIPDs_;
-    std::vector<uint8_t> recordEncodedIPDs_;
-    std::vector<uint16_t> recordRawPulseWidths_;
-    std::vector<uint8_t> recordEncodedPulseWidths_;
-
-    // IPD downsampling
-    std::vector<uint16_t> framepoints_;
-    std::vector<uint8_t> frameToCode_;
-    uint16_t maxFramepoint_;
+    // "<movie>/", the start of every record name
+    std::string recordNamePrefix_;
+
+    // read scores, per input file
+    std::vector<ReadScoreTable> readScores_;
+
+    // ZMWs converted, others are not read (if read in bulk)
+    const ZmwSelection zmwSelection_;
+
+    // dropped by read filters, for the run report
+    std::atomic<uint64_t> numZmwsFiltered_;
+    std::atomic<uint64_t> numRecordsFiltered_;
+
+    // IPD & PulseWidth downsampling (shared, read-only, by worker threads)
+    const FramesEncoder framesEncoder_;
 
     // store tags
     //
@@ -179,88 +391,82 @@ protected:
     //
     // RG:Z - standard SAM/BAM RG tag, contains the corresponding @RG:ID
     //
-    static const std::string Tag_zm;
-    static const std::string Tag_rq;
-    static const std::string Tag_cx;
-    static const std::string Tag_sn;
-    static const std::string Tag_dq;
-    static const std::string Tag_dt;
-    static const std::string Tag_iq;
-    static const std::string Tag_mq;
-    static const std::string Tag_sq;
-    static const std::string Tag_st;
-    static const std::string Tag_ip;
-    static const std::string Tag_pw;
-    static const std::string Tag_sc;
-    static const std::string Tag_sz;
-    static const std::string Tag_RG;
-
-    // store re-used tag values
-    //
-    // Adapter Tag    = Tag('A', ASCII_CHAR)
-    // LowQuality Tag = Tag('L', ASCII_CHAR)
-    // Filtered Tag   = Tag('F', ASCII_CHAR)
-    // NormalZMW Tag  = Tag('N', ASCII_CHAR)
+    // Tags are written in the order the previous, TagCollection-based
+    // encoding produced (sorted by name, then sz/sc/cx in the order added),
+    // so output is unchanged.
     //
-    static const PacBio::BAM::Tag lowQualityTag_;
-    static const PacBio::BAM::Tag adapterTag_;
-    static const PacBio::BAM::Tag filteredTag_;
-    static const PacBio::BAM::Tag normalZmwTag_;
+    static const char* const Tag_zm;
+    static const char* const Tag_rq;
+    static const char* const Tag_cx;
+    static const char* const Tag_sn;
+    static const char* const Tag_dq;
+    static const char* const Tag_dt;
+    static const char* const Tag_iq;
+    static const char* const Tag_mq;
+    static const char* const Tag_sq;
+    static const char* const Tag_st;
+    static const char* const Tag_ip;
+    static const char* const Tag_pw;
+    static const char* const Tag_sc;
+    static const char* const Tag_sz;
+    static const char* const Tag_qs;
+    static const char* const Tag_qe;
+    static const char* const Tag_np;
+    static const char* const Tag_RG;
+
+    // store re-used tag values (sc:A & sz:A)
+    static const char lowQualityTag_ = 'L';
+    static const char adapterTag_    = 'A';
+    static const char filteredTag_   = 'F';
+    static const char normalZmwTag_  = 'N';
 };
 
 // Static Tag-name initializers
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_zm = "zm";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_zm = "zm";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_rq = "rq";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_rq = "rq";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_cx = "cx";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_cx = "cx";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_sn = "sn";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_sn = "sn";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_dq = "dq";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_dq = "dq";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_dt = "dt";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_dt = "dt";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_iq = "iq";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_iq = "iq";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_mq = "mq";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_mq = "mq";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_sq = "sq";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_sq = "sq";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_st = "st";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_st = "st";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_ip = "ip";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_ip = "ip";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_pw = "pw";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_pw = "pw";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_sc = "sc";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_sc = "sc";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_sz = "sz";
+const char* const ConverterBase<RecordType, HdfReader>::Tag_sz = "sz";
 template<typename RecordType, typename HdfReader>
-const std::string ConverterBase<RecordType, HdfReader>::Tag_RG = "RG";
-
-// Static Tag-Value initializers
-template<typename RecordType, typename HdfReader>
-const PacBio::BAM::Tag ConverterBase<RecordType, HdfReader>::lowQualityTag_ =
-        PacBio::BAM::Tag('L', PacBio::BAM::TagModifier::ASCII_CHAR);
-
+const char* const ConverterBase<RecordType, HdfReader>::Tag_qs = "qs";
 template<typename RecordType, typename HdfReader>
-const PacBio::BAM::Tag ConverterBase<RecordType, HdfReader>::adapterTag_ =
-        PacBio::BAM::Tag('A', PacBio::BAM::TagModifier::ASCII_CHAR);
-
+const char* const ConverterBase<RecordType, HdfReader>::Tag_qe = "qe";
 template<typename RecordType, typename HdfReader>
-const PacBio::BAM::Tag ConverterBase<RecordType, HdfReader>::filteredTag_ =
-        PacBio::BAM::Tag('F', PacBio::BAM::TagModifier::ASCII_CHAR);
-
+const char* const ConverterBase<RecordType, HdfReader>::Tag_np = "np";
 template<typename RecordType, typename HdfReader>
-const PacBio::BAM::Tag ConverterBase<RecordType, HdfReader>::normalZmwTag_ =
-        PacBio::BAM::Tag('N', PacBio::BAM::TagModifier::ASCII_CHAR);
+const char* const ConverterBase<RecordType, HdfReader>::Tag_RG = "RG";
 
 // Constructor
 template<typename RecordType, typename HdfReader>
 ConverterBase<RecordType, HdfReader>::ConverterBase(Settings& settings)
     : IConverter(settings)
+    , threadBudget_{ 1, false, 0, 0 }
+    , zmwSelection_(settings)
+    , numZmwsFiltered_(0)
+    , numRecordsFiltered_(0)
 { }
 
 // Destructor
@@ -297,18 +503,462 @@ std::string ConverterBase<RecordType, HdfReader>::ScrapsReadGroupId(void)
     return settings_.scrapsReadGroupId;
 }
 
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::InitFile(HdfReader* reader,
+                                                    const size_t fileIndex)
+{
+    InitReadScores(reader, fileIndex);
+
+    if (UsesBatchReader()) {
+        if (batchReaders_.size() <= fileIndex)
+            batchReaders_.resize(fileIndex + 1);
+
+        // compressed chunks are inflated by the reader thread, helped by
+        // the shared pool
+        try {
+            batchReaders_.at(fileIndex).reset(new BaxBatchReader(filenameForReader_[reader],
+                                                                 BaseCallFields(),
+                                                                 fileAccess_,
+                                                                 &hdfMutex_,
+                                                                 threadPool_.get()));
+        } catch (std::exception& e) {
+            AddErrorMessage(std::string(e.what()));
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename RecordType, typename HdfReader>
+void ConverterBase<RecordType, HdfReader>::SelectZmws(void)
+{
+    // shards are contiguous slices of all files' bases, in input order: a
+    // ZMW belongs to the shard holding the middle of its bases
+    uint64_t totalBases = 0;
+    for (const auto& batchReader : batchReaders_)
+        totalBases += (batchReader ? batchReader->TotalNumBases() : 0);
+    const uint64_t numShards = settings_.numShards;
+    const uint64_t shardIndex = settings_.shardIndex;
+
+    uint64_t fileStart = 0;
+    for (size_t fileIndex = 0; fileIndex < batchReaders_.size(); ++fileIndex) {
+        if (!batchReaders_[fileIndex])
+            continue;
+
+        // plan ahead: skip reading ZMWs that will not be written
+        BaxBatchReader& batchReader = *batchReaders_[fileIndex];
+        std::vector<bool> selected(batchReader.NumZmws());
+        bool allSelected = true;
+        for (size_t i = 0; i < selected.size(); ++i) {
+            const ZmwSummary zmw{ fileIndex,
+                                  batchReader.HoleNumber(i),
+                                  batchReader.HoleStatus(i),
+                                  batchReader.NumBases(i) };
+            if (numShards > 1) {
+                const uint64_t middle = fileStart + batchReader.BaseOffset(i) + zmw.readLength/2;
+                const uint64_t shard = (totalBases > 0 ? middle * numShards / totalBases : 0);
+                if (shard != shardIndex) {
+                    selected[i] = false;
+                    allSelected = false;
+                    continue;
+                }
+            }
+            selected[i] = SelectsZmw(zmw) && EmitsRecords(zmw);
+            allSelected = allSelected && selected[i];
+        }
+        if (!allSelected)
+            batchReader.Select(selected);
+        fileStart += batchReader.TotalNumBases();
+    }
+}
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::PassesFilters(const ZmwSummary& zmw) const
+{
+    return (settings_.minReadScore <= 0.0f) ||
+           (readScores_.at(zmw.fileIndex).Score(zmw.holeNumber) >= settings_.minReadScore);
+}
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::SelectsZmw(const ZmwSummary& zmw)
+{
+    if (!zmwSelection_.Contains(zmw.holeNumber))
+        return false;
+    if (!PassesFilters(zmw)) {
+        ++numZmwsFiltered_;
+        return false;
+    }
+    return true;
+}
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::EmitsRecords(const ZmwSummary& zmw)
+{
+    (void)zmw;
+    return true;
+}
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::ConvertFiles(const PacBio::BAM::BamHeader& header,
+                                                        const PacBio::BAM::BamHeader& scrapsHeader)
+{
+    using namespace PacBio::BAM;
+
+    // One pool inflates input chunks and compresses the BGZF blocks of every
+    // output file, so adding writers (or BAX parts converted concurrently)
+    // does not add threads. It gets the part of --threads not taken by
+    // readers, writers & conversion workers.
+    threadBudget_ = SplitThreads(settings_.numThreads, readers_.size(), settings_.prefetchDepth);
+    try {
+        threadPool_.reset(new TaskPool(threadBudget_.numPoolThreads));
+    } catch (std::exception& e) {
+        AddErrorMessage(e.what());
+        return false;
+    }
+
+    // load per-file data up front, conversion of files may then overlap
+    for (size_t i = 0; i < readers_.size(); ++i) {
+        if (!InitFile(readers_.at(i), i))
+            return false;
+    }
+    SelectZmws();
+
+    if (threadBudget_.numConcurrentFiles > 1)
+        return ConvertFilesInParallel(header, scrapsHeader);
+
+    // one file at a time: write directly to output, PBI is built as
+    // records are written
+    try {
+        RawBamWriter writer(settings_.outputBamFilename, header, threadPool_->HtsPool(),
+                            settings_.compressionLevel, settings_.adaptiveCompression);
+        std::unique_ptr<RawBamWriter> scrapsWriter;
+        if (!settings_.scrapsBamFilename.empty()) {
+            scrapsWriter.reset(new RawBamWriter(settings_.scrapsBamFilename, scrapsHeader, threadPool_->HtsPool(),
+                                                settings_.compressionLevel, settings_.adaptiveCompression));
+        }
+
+        for (size_t i = 0; i < readers_.size(); ++i) {
+            if (!ConvertFile(readers_.at(i), i, settings_.prefetchMemoryMB << 20, &writer, scrapsWriter.get()))
+                return false;
+        }
+
+        writer.Close();
+        if (scrapsWriter)
+            scrapsWriter->Close();
+        AddCompressionStats(writer, scrapsWriter.get());
+    } catch (std::exception& e) {
+        AddErrorMessage(e.what());
+        return false;
+    }
+    return true;
+}
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::ConvertFilesInParallel(const PacBio::BAM::BamHeader& header,
+                                                                  const PacBio::BAM::BamHeader& scrapsHeader)
+{
+    using namespace PacBio::BAM;
+
+    // Each BAX part holds a disjoint range of ZMWs. Convert parts concurrently
+    // into their own (indexed) BAM files, then join those at the BGZF block
+    // level and merge their PBI files.
+    const size_t numFiles = readers_.size();
+    const size_t numConcurrentFiles = threadBudget_.numConcurrentFiles;
+    const size_t maxPrefetchBytes = (settings_.prefetchMemoryMB << 20) / numConcurrentFiles;
+    const bool hasScraps = !settings_.scrapsBamFilename.empty();
+
+    std::vector<std::string> partFilenames;
+    std::vector<std::string> scrapsPartFilenames;
+    for (size_t i = 0; i < numFiles; ++i) {
+        const std::string suffix = "." + std::to_string(i) + ".part";
+        partFilenames.push_back(settings_.outputBamFilename + suffix);
+        if (hasScraps)
+            scrapsPartFilenames.push_back(settings_.scrapsBamFilename + suffix);
+    }
+
+    std::atomic<size_t> nextFile(0);
+    std::atomic<bool> failed(false);
+    auto convertParts = [&]() {
+        size_t i;
+        while (!failed && (i = nextFile++) < numFiles) {
+            bool converted = false;
+            try {
+                RawBamWriter writer(partFilenames.at(i), header, threadPool_->HtsPool(),
+                                    settings_.compressionLevel, settings_.adaptiveCompression);
+                std::unique_ptr<RawBamWriter> scrapsWriter;
+                if (hasScraps) {
+                    scrapsWriter.reset(new RawBamWriter(scrapsPartFilenames.at(i), scrapsHeader, threadPool_->HtsPool(),
+                                                        settings_.compressionLevel, settings_.adaptiveCompression));
+                }
+                converted = ConvertFile(readers_.at(i), i, maxPrefetchBytes, &writer, scrapsWriter.get());
+                if (converted) {
+                    writer.Close();
+                    if (scrapsWriter)
+                        scrapsWriter->Close();
+                    AddCompressionStats(writer, scrapsWriter.get());
+                }
+            } catch (std::exception& e) {
+                AddErrorMessage(e.what());
+            }
+            if (!converted)
+                failed = true;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numConcurrentFiles; ++i)
+        threads.emplace_back(convertParts);
+    for (std::thread& t : threads)
+        t.join();
+
+    bool success = !failed;
+    if (success) {
+        try {
+            ConcatenateParts(partFilenames, settings_.outputBamFilename);
+            if (hasScraps)
+                ConcatenateParts(scrapsPartFilenames, settings_.scrapsBamFilename);
+        } catch (std::exception& e) {
+            AddErrorMessage(e.what());
+            success = false;
+        }
+    }
+
+    for (const std::string& fn : partFilenames) {
+        remove(fn.c_str());
+        remove((fn + ".pbi").c_str());
+    }
+    for (const std::string& fn : scrapsPartFilenames) {
+        remove(fn.c_str());
+        remove((fn + ".pbi").c_str());
+    }
+    return success;
+}
+
+template<typename RecordType, typename HdfReader>
+typename ConverterBase<RecordType, HdfReader>::ThreadBudget
+ConverterBase<RecordType, HdfReader>::SplitThreads(const size_t numThreads,
+                                                   const size_t numFiles,
+                                                   const size_t prefetchDepth)
+{
+    ThreadBudget budget{ 1, false, 0, 0 };
+    if (numThreads <= 1)
+        return budget;
+
+    // about 4 threads per file converted at once, each taking a reader &
+    // a writing thread off the top
+    budget.numConcurrentFiles = std::max(static_cast<size_t>(1), std::min(numFiles, numThreads / 4));
+    const size_t numLeft = numThreads - 2 * budget.numConcurrentFiles;
+
+    // split the rest about evenly between workers & the pool (compression
+    // is about half of conversion time), keeping at least one pool thread
+    if (numLeft > 0) {
+        budget.numWorkersPerFile = std::min((numLeft + budget.numConcurrentFiles) / (2 * budget.numConcurrentFiles),
+                                            (numLeft - 1) / budget.numConcurrentFiles);
+    }
+    budget.numPoolThreads = numLeft - budget.numWorkersPerFile * budget.numConcurrentFiles;
+    budget.usingReader = (prefetchDepth > 0 || budget.numWorkersPerFile > 0);
+    return budget;
+}
+
+template<typename RecordType, typename HdfReader>
+void ConverterBase<RecordType, HdfReader>::AddCompressionStats(const RawBamWriter& writer,
+                                                               const RawBamWriter* scrapsWriter)
+{
+    OutputStats mainStats;
+    mainStats.bytesAtLevel = writer.BytesAtLevel();
+    mainStats.compressSeconds = writer.CompressSeconds();
+    mainStats.writeSeconds = writer.WriteSeconds();
+    OutputStats scrapsStats;
+    if (scrapsWriter) {
+        scrapsStats.bytesAtLevel = scrapsWriter->BytesAtLevel();
+        scrapsStats.compressSeconds = scrapsWriter->CompressSeconds();
+        scrapsStats.writeSeconds = scrapsWriter->WriteSeconds();
+    }
+    AddOutputStats(mainStats, scrapsStats);
+}
+
+template<typename RecordType, typename HdfReader>
+void ConverterBase<RecordType, HdfReader>::ConcatenateParts(const std::vector<std::string>& partFilenames,
+                                                            const std::string& outputFilename)
+{
+    std::vector<std::string> partPbiFilenames;
+    for (const std::string& fn : partFilenames)
+        partPbiFilenames.push_back(fn + ".pbi");
+
+    const std::vector<BgzfConcat::Segment> segments =
+        BgzfConcat::Concatenate(partFilenames, outputFilename);
+    PbiConcat::Concatenate(partPbiFilenames, segments, outputFilename + ".pbi");
+}
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::ConvertFile(HdfReader* reader,
+                                                       const size_t fileIndex,
+                                                       const size_t maxPrefetchBytes,
+                                                       RawBamWriter* writer,
+                                                       RawBamWriter* scrapsWriter)
+{
+    assert(reader);
+    assert(writer);
+
+    // One reader thread (the only one touching HDF5) fills batches, workers
+    // convert them (or this thread, without any), and this thread writes
+    // them out in their original order. Beyond one batch per worker & one
+    // being written, 'prefetchDepth' batches may be filled ahead. Without a
+    // reader thread, a single batch is read, converted & written in turn,
+    // on this thread.
+    const size_t numWorkers = threadBudget_.numWorkersPerFile;
+    const size_t numBatches = (threadBudget_.usingReader ? std::max(numWorkers, static_cast<size_t>(1)) + 1 + settings_.prefetchDepth
+                                                         : 1);
+    std::vector<ZmwBatch> batches(numBatches);
+    std::vector<ConversionContext> contexts(std::max(numWorkers, static_cast<size_t>(1)));
+    const bool hasScraps = (scrapsWriter != nullptr);
+
+    OrderedPipeline<ZmwBatch> pipeline(&batches, numWorkers);
+    if (maxPrefetchBytes > 0) {
+        const size_t fieldsPerBase = BaseCallFields().size();
+        pipeline.SetMemoryLimit(maxPrefetchBytes, [this, fieldsPerBase](const ZmwBatch& batch) {
+            return BatchInputBytes(batch, fieldsPerBase);
+        });
+    }
+    return pipeline.Run(
+        [&](ZmwBatch* batch) { return FillBatch(reader, fileIndex, batch); },
+        [&](ZmwBatch* batch, size_t worker) { return ConvertBatch(batch, &contexts.at(worker), hasScraps); },
+        [&](ZmwBatch* batch) { return WriteBatch(*batch, writer, scrapsWriter); });
+}
+
+template<typename RecordType, typename HdfReader>
+size_t ConverterBase<RecordType, HdfReader>::BatchInputBytes(const ZmwBatch& batch,
+                                                             const size_t fieldsPerBase) const
+{
+    if (batch.columns.numZmws == batch.size && batch.size > 0)
+        return batch.columns.NumBytes();
+
+    // read record by record, count every field at (at least) a byte per base
+    size_t numBases = 0;
+    for (size_t i = 0; i < batch.size; ++i)
+        numBases += batch.zmws[i].length;
+    return numBases * fieldsPerBase;
+}
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::FillBatch(HdfReader* reader,
+                                                     const size_t fileIndex,
+                                                     ZmwBatch* batch)
+{
+    assert(reader);
+    assert(batch);
+
+    if (batch->zmws.size() < BatchSize)
+        batch->zmws.resize(BatchSize);
+
+    batch->fileIndex = fileIndex;
+    batch->size = 0;
+
+    // one read per field for the whole batch, ZMWs are views into it (the
+    // batch reader takes the HDF5 lock itself, and inflates without it)
+    if (fileIndex < batchReaders_.size() && batchReaders_[fileIndex]) {
+        batch->size = batchReaders_[fileIndex]->ReadNext(BatchSize, &batch->columns);
+        for (size_t i = 0; i < batch->size; ++i)
+            BaxBatchReader::View(batch->columns, i, &batch->zmws[i]);
+        return batch->size > 0;
+    }
+
+    // HDF5 is not thread-safe, other files may be read concurrently
+    std::lock_guard<std::mutex> lock(hdfMutex_);
+    try {
+        while (batch->size < BatchSize && reader->GetNext(batch->zmws[batch->size]))
+            ++batch->size;
+    } catch (H5::Exception& e) {
+        throw std::runtime_error("could not read ZMWs from BAX file: "+e.getDetailMsg());
+    }
+    return batch->size > 0;
+}
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::ConvertBatch(ZmwBatch* batch,
+                                                        ConversionContext* context,
+                                                        const bool hasScraps)
+{
+    assert(batch);
+    assert(context);
+
+    batch->records.Clear();
+    batch->scraps.Clear();
+    context->fileIndex = batch->fileIndex;
+
+    const ReadScoreTable& readScores = readScores_.at(batch->fileIndex);
+    const bool isSelecting = !UsesBatchReader();    // else done before reading
+
+    bool success = true;
+    for (size_t i = 0; i < batch->size; ++i) {
+        RecordType& smrtRecord = batch->zmws[i];
+        if (success) {
+            try {
+                const ZmwSummary zmw{ batch->fileIndex,
+                                      smrtRecord.zmwData.holeNumber,
+                                      smrtRecord.zmwData.holeStatus,
+                                      smrtRecord.length };
+                if (!isSelecting || SelectsZmw(zmw)) {
+                    context->readScore = readScores.Score(smrtRecord.zmwData.holeNumber);
+                    success = ConvertZmw(smrtRecord,
+                                         context,
+                                         &batch->records,
+                                         (hasScraps ? &batch->scraps : nullptr));
+                }
+            } catch (std::exception& e) {
+                AddErrorMessage(std::string(e.what()));
+                success = false;
+            }
+        }
+        smrtRecord.Free();
+    }
+    return success;
+}
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::WriteBatch(const ZmwBatch& batch,
+                                                      RawBamWriter* writer,
+                                                      RawBamWriter* scrapsWriter)
+{
+    OutputStats mainStats;
+    OutputStats scrapsStats;
+    try {
+        for (size_t i = 0; i < batch.records.Size(); ++i) {
+            writer->Write(batch.records[i]);
+            mainStats.totalLength += batch.records[i].SequenceLength();
+        }
+        mainStats.numRecords = batch.records.Size();
+
+        if (scrapsWriter) {
+            for (size_t i = 0; i < batch.scraps.Size(); ++i) {
+                scrapsWriter->Write(batch.scraps[i]);
+                scrapsStats.totalLength += batch.scraps[i].SequenceLength();
+            }
+            scrapsStats.numRecords = batch.scraps.Size();
+        }
+    } catch (std::exception& e) {
+        AddErrorMessage(e.what());
+        return false;
+    }
+
+    AddOutputStats(mainStats, scrapsStats);
+    return true;
+}
+
 template<typename RecordType, typename HdfReader>
 bool ConverterBase<RecordType, HdfReader>::ConvertRecord(
         const RecordType& smrtRead,
         const int subreadStart,
         const int subreadEnd,
         const std::string& rgId,
-        PacBio::BAM::BamRecordImpl* bamRecord)
+        ConversionContext* context,
+        RawBamRecord* bamRecord)
 {
     using namespace PacBio;
     using namespace PacBio::BAM;
 
     // sanity check
+    assert(context);
     assert(bamRecord);
 
     const UInt holeNumber   = smrtRead.zmwData.holeNumber;
@@ -318,7 +968,7 @@ bool ConverterBase<RecordType, HdfReader>::ConvertRecord(
 
     // store sequence
     // NOTE - qualities are empty (per PacBio BAM spec)
-    SetSequenceAndQualities(bamRecord, smrtRead, subreadStart, length);
+    SetSequenceAndQualities(bamRecord, smrtRead, subreadStart, length, context);
 
     // check settings/existence of *QV/*Tag data
     if (settings_.usingDeletionQV && smrtRead.deletionQV.Empty())
@@ -369,97 +1019,59 @@ bool ConverterBase<RecordType, HdfReader>::ConvertRecord(
         return false;
     }
 
-    // fetch *QV/*Tag data
-    if (settings_.usingDeletionQV) {
-        recordDeletionQVs_.assign((uint8_t*)smrtRead.deletionQV.data + subreadStart,
-                                  (uint8_t*)smrtRead.deletionQV.data + subreadStart + length);
-    }
-    if (settings_.usingInsertionQV) {
-        recordInsertionQVs_.assign((uint8_t*)smrtRead.insertionQV.data + subreadStart,
-                                   (uint8_t*)smrtRead.insertionQV.data + subreadStart + length);
-    }
-    if (settings_.usingMergeQV) {
-        recordMergeQVs_.assign((uint8_t*)smrtRead.mergeQV.data + subreadStart,
-                               (uint8_t*)smrtRead.mergeQV.data + subreadStart + length);
-    }
-    if (settings_.usingSubstitutionQV) {
-        recordSubstitutionQVs_.assign((uint8_t*)smrtRead.substitutionQV.data + subreadStart,
-                                      (uint8_t*)smrtRead.substitutionQV.data + subreadStart + length);
-    }
-    if (settings_.usingDeletionTag) {
-        recordDeletionTags_.assign((char*)smrtRead.deletionTag + subreadStart,
-                                   (char*)smrtRead.deletionTag + subreadStart + length);
-    }
-    if (settings_.usingSubstitutionTag) {
-        recordSubstitutionTags_.assign((char*)smrtRead.substitutionTag + subreadStart,
-                                       (char*)smrtRead.substitutionTag + subreadStart + length);
-    }
-
-    // fetch IPDs, then maybe encode
-    if (settings_.usingIPD) {
-        recordRawIPDs_.assign((uint16_t*)smrtRead.preBaseFrames + subreadStart,
-                              (uint16_t*)smrtRead.preBaseFrames + subreadStart + length);
-
-        // if not using full data, encode
-        if (!settings_.losslessFrames)
-            recordEncodedIPDs_ = std::move(Frames::Encode(recordRawIPDs_));
-    }
-
-    // fetch PulseWidths, then maybe encode
-    if (settings_.usingPulseWidth) {
-        recordRawPulseWidths_.assign((uint16_t*)smrtRead.widthInFrames + subreadStart,
-                                     (uint16_t*)smrtRead.widthInFrames + subreadStart + length);
-
-        // if not using full data, encode
-        if (!settings_.losslessFrames)
-            recordEncodedPulseWidths_ = std::move(Frames::Encode(recordRawPulseWidths_));
-    }
-
-    TagCollection tags;
-    tags[Tag_RG] = rgId;
-    tags[Tag_zm] = static_cast<int32_t>(holeNumber);
-
-    // HQRegionSNR, TODO: should I do this in AddModeTags?
-    if (HeaderReadType() != "CCS")
-    {
-        // Stored as 'ACGT' in BAM, no fixed order in SMRTSequence
-        std::vector<float> hqSnr = { smrtRead.HQRegionSnr('A'),
-                                smrtRead.HQRegionSnr('C'),
-                                smrtRead.HQRegionSnr('G'),
-                                smrtRead.HQRegionSnr('T')};
-        tags[Tag_sn] = hqSnr;
-    }
-
-    AddModeTags(&tags, smrtRead, subreadStart, subreadEnd);
-
-    if (!readScores_.empty())
-        tags[Tag_rq] = static_cast<float>(readScores_.at(indexForHoleNumber_[holeNumber]));
-    else
-        tags[Tag_rq] = static_cast<float>(0.0f);
-
-    if (settings_.usingDeletionQV)      tags[Tag_dq] = recordDeletionQVs_.Fastq();
-    if (settings_.usingDeletionTag)     tags[Tag_dt] = recordDeletionTags_;
-    if (settings_.usingInsertionQV)     tags[Tag_iq] = recordInsertionQVs_.Fastq();
-    if (settings_.usingMergeQV)         tags[Tag_mq] = recordMergeQVs_.Fastq();
-    if (settings_.usingSubstitutionQV)  tags[Tag_sq] = recordSubstitutionQVs_.Fastq();
-    if (settings_.usingSubstitutionTag) tags[Tag_st] = recordSubstitutionTags_;
-
+    // store tags, straight from the BAX data
+    bamRecord->AddStringTag(Tag_RG, rgId);
+    if (settings_.usingDeletionQV)
+        bamRecord->AddQvTag(Tag_dq, (uint8_t*)smrtRead.deletionQV.data + subreadStart, length);
+    if (settings_.usingDeletionTag)
+        bamRecord->AddStringTag(Tag_dt, (char*)smrtRead.deletionTag + subreadStart, length);
     if (settings_.usingIPD) {
+        const uint16_t* ipds = (uint16_t*)smrtRead.preBaseFrames + subreadStart;
         if (settings_.losslessFrames)
-            tags[Tag_ip] = recordRawIPDs_;
+            bamRecord->AddUInt16ArrayTag(Tag_ip, ipds, length);
         else
-            tags[Tag_ip] = recordEncodedIPDs_;
-
+            framesEncoder_.Encode(ipds, length, bamRecord->AddUInt8ArrayTag(Tag_ip, length));
     }
-
+    if (settings_.usingInsertionQV)
+        bamRecord->AddQvTag(Tag_iq, (uint8_t*)smrtRead.insertionQV.data + subreadStart, length);
+    if (settings_.usingMergeQV)
+        bamRecord->AddQvTag(Tag_mq, (uint8_t*)smrtRead.mergeQV.data + subreadStart, length);
+    bamRecord->AddInt32Tag(Tag_np, NumPasses(smrtRead));
     if (settings_.usingPulseWidth) {
+        const uint16_t* pulseWidths = (uint16_t*)smrtRead.widthInFrames + subreadStart;
         if (settings_.losslessFrames)
-            tags[Tag_pw] = recordRawPulseWidths_;
+            bamRecord->AddUInt16ArrayTag(Tag_pw, pulseWidths, length);
         else
-            tags[Tag_pw] = recordEncodedPulseWidths_;
+            framesEncoder_.Encode(pulseWidths, length, bamRecord->AddUInt8ArrayTag(Tag_pw, length));
     }
+    if (HasQueryTags()) {
+        bamRecord->AddInt32Tag(Tag_qe, subreadEnd);
+        bamRecord->AddInt32Tag(Tag_qs, subreadStart);
+    }
+    bamRecord->AddFloatTag(Tag_rq, context->readScore);
+
+    // HQRegionSNR, stored as 'ACGT' in BAM, no fixed order in SMRTSequence
+    if (HeaderReadType() != "CCS") {
+        const float hqSnr[4] = { smrtRead.HQRegionSnr('A'),
+                                 smrtRead.HQRegionSnr('C'),
+                                 smrtRead.HQRegionSnr('G'),
+                                 smrtRead.HQRegionSnr('T') };
+        bamRecord->AddFloatArrayTag(Tag_sn, hqSnr, 4);
+    }
+
+    if (settings_.usingSubstitutionQV)
+        bamRecord->AddQvTag(Tag_sq, (uint8_t*)smrtRead.substitutionQV.data + subreadStart, length);
+    if (settings_.usingSubstitutionTag)
+        bamRecord->AddStringTag(Tag_st, (char*)smrtRead.substitutionTag + subreadStart, length);
+    bamRecord->AddInt32Tag(Tag_zm, static_cast<int32_t>(holeNumber));
 
-    bamRecord->Tags(tags);
+    // PBI fields
+    bamRecord->pbi.rgId       = static_cast<int32_t>(std::stoul(rgId, nullptr, 16));
+    bamRecord->pbi.qStart     = subreadStart;
+    bamRecord->pbi.qEnd       = subreadEnd;
+    bamRecord->pbi.holeNumber = static_cast<int32_t>(holeNumber);
+    bamRecord->pbi.readQual   = context->readScore;
+    bamRecord->pbi.ctxtFlag   = 0;
 
     // if we get here, everything should be OK
     return true;
@@ -470,27 +1082,16 @@ bool ConverterBase<RecordType, HdfReader>::WriteRecord(const RecordType& smrtRec
                                                        const int recordStart,
                                                        const int recordEnd,
                                                        const std::string& readGroupId,
-                                                       PacBio::BAM::BamWriter* writer)
+                                                       ConversionContext* context,
+                                                       RecordBuffer* output)
 {
     // attempt convert BAX to BAM
-    if (!ConvertRecord(smrtRecord,
-                       recordStart,
-                       recordEnd,
-                       readGroupId,
-                       &bamRecord_))
-    {
-        return false;
-    }
-
-    // attempt write BAM to file
-    try {
-        writer->Write(bamRecord_);
-    } catch (std::exception&) {
-        AddErrorMessage("failed to write BAM record");
-        return false;
-    }
-
-    return true;
+    return ConvertRecord(smrtRecord,
+                         recordStart,
+                         recordEnd,
+                         readGroupId,
+                         context,
+                         output->Next());
 }
 
 template<typename RecordType, typename HdfReader>
@@ -498,37 +1099,24 @@ bool ConverterBase<RecordType, HdfReader>::WriteFilteredRecord(const RecordType&
                                                                const int recordStart,
                                                                const int recordEnd,
                                                                const std::string& readGroupId,
-                                                               PacBio::BAM::BamWriter* writer)
+                                                               ConversionContext* context,
+                                                               RecordBuffer* output)
 {
     // attempt convert BAX to BAM
+    RawBamRecord* bamRecord = output->Next();
     if (!ConvertRecord(smrtRecord,
                        recordStart,
                        recordEnd,
                        readGroupId,
-                       &bamRecord_))
+                       context,
+                       bamRecord))
     {
         return false;
     }
 
     // add scrap tags
-    if (!bamRecord_.AddTag(Tag_sz, normalZmwTag_))
-    {
-        AddErrorMessage("failed to add scrap's zmw classification tag");
-        return false;
-    }
-    if (!bamRecord_.AddTag(Tag_sc, filteredTag_))
-    {
-        AddErrorMessage("failed to add scrap's filtered tag");
-        return false;
-    }
-
-    // attempt write BAM to file
-    try {
-        writer->Write(bamRecord_);
-    } catch (std::exception&) {
-        AddErrorMessage("failed to write BAM record");
-        return false;
-    }
+    bamRecord->AddCharTag(Tag_sz, normalZmwTag_);
+    bamRecord->AddCharTag(Tag_sc, filteredTag_);
 
     return true;
 }
@@ -539,44 +1127,28 @@ bool ConverterBase<RecordType, HdfReader>::WriteFilteredRecord(const RecordType&
                                                                const int recordEnd,
                                                                const std::string& readGroupId,
                                                                const uint8_t contextFlags,
-                                                               PacBio::BAM::BamWriter* writer)
+                                                               ConversionContext* context,
+                                                               RecordBuffer* output)
 {
     // attempt convert BAX to BAM
+    RawBamRecord* bamRecord = output->Next();
     if (!ConvertRecord(smrtRecord,
                        recordStart,
                        recordEnd,
                        readGroupId,
-                       &bamRecord_))
+                       context,
+                       bamRecord))
     {
         return false;
     }
 
     // add scrap tags
-    if (!bamRecord_.AddTag(Tag_sz, normalZmwTag_))
-    {
-        AddErrorMessage("failed to add scrap's zmw classification tag");
-        return false;
-    }
-    if (!bamRecord_.AddTag(Tag_sc, filteredTag_))
-    {
-        AddErrorMessage("failed to add scrap's filtered tag");
-        return false;
-    }
+    bamRecord->AddCharTag(Tag_sz, normalZmwTag_);
+    bamRecord->AddCharTag(Tag_sc, filteredTag_);
 
     // add context tag
-    if (!bamRecord_.AddTag(Tag_cx, contextFlags))
-    {
-        AddErrorMessage("failed to add context flag tag");
-        return false;
-    }
-
-    // attempt write BAM to file
-    try {
-        writer->Write(bamRecord_);
-    } catch (std::exception&) {
-        AddErrorMessage("failed to write BAM record");
-        return false;
-    }
+    bamRecord->AddUInt8Tag(Tag_cx, contextFlags);
+    bamRecord->pbi.ctxtFlag = contextFlags;
 
     return true;
 }
@@ -586,37 +1158,24 @@ bool ConverterBase<RecordType, HdfReader>::WriteLowQualityRecord(const RecordTyp
                                                                  const int recordStart,
                                                                  const int recordEnd,
                                                                  const std::string& readGroupId,
-                                                                 PacBio::BAM::BamWriter* writer)
+                                                                 ConversionContext* context,
+                                                                 RecordBuffer* output)
 {
     // attempt convert BAX to BAM
+    RawBamRecord* bamRecord = output->Next();
     if (!ConvertRecord(smrtRecord,
                        recordStart,
                        recordEnd,
                        readGroupId,
-                       &bamRecord_))
+                       context,
+                       bamRecord))
     {
         return false;
     }
 
     // add scrap tags
-    if (!bamRecord_.AddTag(Tag_sz, normalZmwTag_))
-    {
-        AddErrorMessage("failed to add scrap's zmw classification tag");
-        return false;
-    }
-    if (!bamRecord_.AddTag(Tag_sc, lowQualityTag_))
-    {
-        AddErrorMessage("failed to add scrap's low-quality region tag");
-        return false;
-    }
-
-    // attempt write BAM to file
-    try {
-        writer->Write(bamRecord_);
-    } catch (std::exception&) {
-        AddErrorMessage("failed to write BAM record");
-        return false;
-    }
+    bamRecord->AddCharTag(Tag_sz, normalZmwTag_);
+    bamRecord->AddCharTag(Tag_sc, lowQualityTag_);
 
     return true;
 }
@@ -626,37 +1185,24 @@ bool ConverterBase<RecordType, HdfReader>::WriteAdapterRecord(const RecordType&
                                                               const int recordStart,
                                                               const int recordEnd,
                                                               const std::string& readGroupId,
-                                                              PacBio::BAM::BamWriter* writer)
+                                                              ConversionContext* context,
+                                                              RecordBuffer* output)
 {
     // attempt convert BAX to BAM
+    RawBamRecord* bamRecord = output->Next();
     if (!ConvertRecord(smrtRecord,
                        recordStart,
                        recordEnd,
                        readGroupId,
-                       &bamRecord_))
+                       context,
+                       bamRecord))
     {
         return false;
     }
 
     // add scrap tags
-    if (!bamRecord_.AddTag(Tag_sz, normalZmwTag_))
-    {
-        AddErrorMessage("failed to add scrap's zmw classification tag");
-        return false;
-    }
-    if (!bamRecord_.AddTag(Tag_sc, adapterTag_))
-    {
-        AddErrorMessage("failed to add scrap's adapter tag");
-        return false;
-    }
-
-    // attempt write BAM to file
-    try {
-        writer->Write(bamRecord_);
-    } catch (std::exception&) {
-        AddErrorMessage("failed to write BAM record");
-        return false;
-    }
+    bamRecord->AddCharTag(Tag_sz, normalZmwTag_);
+    bamRecord->AddCharTag(Tag_sc, adapterTag_);
 
     return true;
 }
@@ -667,122 +1213,142 @@ bool ConverterBase<RecordType, HdfReader>::WriteSubreadRecord(const RecordType&
                                                               const int recordEnd,
                                                               const std::string& readGroupId,
                                                               const uint8_t contextFlags,
-                                                              PacBio::BAM::BamWriter* writer)
+                                                              ConversionContext* context,
+                                                              RecordBuffer* output)
 {
     // attempt convert BAX to BAM
+    RawBamRecord* bamRecord = output->Next();
     if (!ConvertRecord(smrtRecord,
                        recordStart,
                        recordEnd,
                        readGroupId,
-                       &bamRecord_))
-    {
-        return false;
-    }
-
-    // Try to add the additional tag supplied by the caller
-    if (!bamRecord_.AddTag(Tag_cx, contextFlags))
+                       context,
+                       bamRecord))
     {
-        AddErrorMessage("failed to add context flag tag");
         return false;
     }
 
-    // attempt write BAM to file
-    try {
-        writer->Write(bamRecord_);
-    } catch (std::exception&) {
-        AddErrorMessage("failed to write BAM record");
-        return false;
-    }
+    // add the additional tag supplied by the caller
+    bamRecord->AddUInt8Tag(Tag_cx, contextFlags);
+    bamRecord->pbi.ctxtFlag = contextFlags;
 
     return true;
 }
 
 template<typename RecordType, typename HdfReader>
 void ConverterBase<RecordType, HdfReader>::SetSequenceAndQualities(
-        PacBio::BAM::BamRecordImpl* bamRecord,
+        RawBamRecord* bamRecord,
         const RecordType& smrtRead,
         const int start,
-        const int length)
+        const int length,
+        ConversionContext* context)
 {
-    recordSequence_.assign((const char*)smrtRead.seq + start, length);
-    bamRecord->SetSequenceAndQualities(recordSequence_);
+    bamRecord->SetSequenceAndQualities((const char*)smrtRead.seq + start, length, nullptr);
 }
 
 template<typename RecordType, typename HdfReader>
 void ConverterBase<RecordType, HdfReader>::AddRecordName(
-        PacBio::BAM::BamRecordImpl* bamRecord,
+        RawBamRecord* bamRecord,
         const UInt holeNumber,
         const int start,
         const int end)
 {
-    const std::string name = settings_.movieName + "/"
-                      + std::to_string(holeNumber) + "/"
-                      + std::to_string(start) + "_"
-                      + std::to_string(end);
-    bamRecord->Name(name);
+    ReadName name(recordNamePrefix_);
+    name.Append(static_cast<uint32_t>(holeNumber)).Append('/')
+        .Append(static_cast<uint32_t>(start)).Append('_')
+        .Append(static_cast<uint32_t>(end));
+    bamRecord->Start(name.Data(), name.Size());
 }
 
 template<typename RecordType, typename HdfReader>
-void ConverterBase<RecordType, HdfReader>::AddModeTags(
-        PacBio::BAM::TagCollection* tags,
-        const RecordType& smrtRead,
-        const int start,
-        const int end)
-{
-    (*tags)["qs"] = start;
-    (*tags)["qe"] = end;
-    (*tags)["np"] = static_cast<int32_t>(1);
-}
+int32_t ConverterBase<RecordType, HdfReader>::NumPasses(const RecordType& smrtRead) const
+{ return 1; }
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::HasQueryTags(void) const
+{ return true; }
 
 template<typename RecordType, typename HdfReader>
 HdfReader* ConverterBase<RecordType, HdfReader>::InitHdfReader(void)
 {
     HdfReader* reader = new HdfReader;
-    reader->IncludeField("Basecall");
-    if (HeaderReadType() != "CCS")      reader->IncludeField("HQRegionSNR");
-    if (settings_.usingDeletionQV)      reader->IncludeField("DeletionQV");
-    if (settings_.usingDeletionTag)     reader->IncludeField("DeletionTag");
-    if (settings_.usingInsertionQV)     reader->IncludeField("InsertionQV");
-    if (settings_.usingIPD)             reader->IncludeField("PreBaseFrames");
-    if (settings_.usingMergeQV)         reader->IncludeField("MergeQV");
-    if (settings_.usingPulseWidth)      reader->IncludeField("WidthInFrames");
-    if (settings_.usingSubstitutionQV)  reader->IncludeField("SubstitutionQV");
-    if (settings_.usingSubstitutionTag) reader->IncludeField("SubstitutionTag");
+    for (const std::string& field : BaseCallFields())
+        reader->IncludeField(field);
     return reader;
 }
 
 template<typename RecordType, typename HdfReader>
-void ConverterBase<RecordType, HdfReader>::InitReadScores(HdfReader* reader)
+std::vector<std::string> ConverterBase<RecordType, HdfReader>::BaseCallFields(void) const
+{
+    std::vector<std::string> fields;
+    fields.push_back("Basecall");
+    if (HeaderReadType() != "CCS")      fields.push_back("HQRegionSNR");
+    if (settings_.usingDeletionQV)      fields.push_back("DeletionQV");
+    if (settings_.usingDeletionTag)     fields.push_back("DeletionTag");
+    if (settings_.usingInsertionQV)     fields.push_back("InsertionQV");
+    if (settings_.usingIPD)             fields.push_back("PreBaseFrames");
+    if (settings_.usingMergeQV)         fields.push_back("MergeQV");
+    if (settings_.usingPulseWidth)      fields.push_back("WidthInFrames");
+    if (settings_.usingSubstitutionQV)  fields.push_back("SubstitutionQV");
+    if (settings_.usingSubstitutionTag) fields.push_back("SubstitutionTag");
+    return fields;
+}
+
+template<typename RecordType, typename HdfReader>
+std::string ConverterBase<RecordType, HdfReader>::BaseCallsGroupName(void) const
+{ return (HeaderReadType() == "CCS" ? "/PulseData/ConsensusBaseCalls" : "/PulseData/BaseCalls"); }
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::UsesBatchReader(void) const
+{ return HeaderReadType() != "CCS"; }
+
+template<typename RecordType, typename HdfReader>
+void ConverterBase<RecordType, HdfReader>::InitReadScores(HdfReader* reader,
+                                                          const size_t fileIndex)
 {
     assert(reader);
 
+    if (readScores_.size() <= fileIndex)
+        readScores_.resize(fileIndex + 1);
+
     // fetch read scores
-    readScores_.clear();
+    std::vector<float> readScores;
     if (reader->baseCallsGroup.ContainsObject("ZMWMetrics")) {
         HDFGroup zmwMetricsGroup;
         if (zmwMetricsGroup.Initialize(reader->baseCallsGroup.group, "ZMWMetrics")) {
             if (zmwMetricsGroup.ContainsObject("ReadScore")) {
                 HDFArray<float> readScoresArray;
                 if (readScoresArray.InitializeForReading(zmwMetricsGroup, "ReadScore"))
-                    readScoresArray.ReadDataset(readScores_);
+                    readScoresArray.ReadDataset(readScores);
             }
         }
     }
 
-    // init holenumber -> index lookup
-    indexForHoleNumber_.clear();
-    if (!readScores_.empty()) {
-        for (size_t i = 0; i < readScores_.size(); ++i) {
-            UInt holeNumber;
-            reader->zmwReader.GetHoleNumberAt(i, holeNumber);
-            indexForHoleNumber_[holeNumber] = i;
-        }
-    }
+    // init holenumber -> score lookup
+    std::vector<UInt> holeNumbers;
+    if (!readScores.empty())
+        ReadHoleNumbers(reader, &holeNumbers);
+
+    readScores_.at(fileIndex).Assign(holeNumbers, readScores);
+}
+
+template<typename RecordType, typename HdfReader>
+void ConverterBase<RecordType, HdfReader>::ReadHoleNumbers(HdfReader* reader,
+                                                           std::vector<UInt>* holeNumbers)
+{
+    assert(reader);
+    assert(holeNumbers);
+    holeNumbers->clear();
+    reader->zmwReader.holeNumberArray.ReadDataset(*holeNumbers);
 }
 
 template<typename RecordType, typename HdfReader>
 bool ConverterBase<RecordType, HdfReader>::IsSequencingZmw(const RecordType& record) const
-{ return record.zmwData.holeStatus == 0; }
+{ return IsSequencingZmw(record.zmwData.holeStatus); }
+
+template<typename RecordType, typename HdfReader>
+bool ConverterBase<RecordType, HdfReader>::IsSequencingZmw(const unsigned char holeStatus) const
+{ return holeStatus == 0; }
 
 template<typename RecordType, typename HdfReader>
 bool ConverterBase<RecordType, HdfReader>::LoadChemistryFromMetadataXML(
@@ -852,6 +1418,39 @@ bool ConverterBase<RecordType, HdfReader>::Run(void)
 
     std::set<std::string> movieNames;
 
+    // input file driver
+    if (settings_.usingReadaheadVfd) {
+        try {
+            fileAccess_ = ReadaheadFileDriver::FileAccess();
+        } catch (std::exception& e) {
+            AddErrorMessage(std::string(e.what()));
+            return false;
+        }
+    }
+
+    // HDF5 chunk cache, sized from the chunk layout of the first file (all
+    // parts of a movie are written alike)
+    const auto firstBax = std::find_if(settings_.inputBaxFilenames.cbegin(),
+                                       settings_.inputBaxFilenames.cend(),
+                                       [](const std::string& fn) { return !fn.empty(); });
+    if (firstBax != settings_.inputBaxFilenames.cend()) {
+        try {
+            const ChunkCacheConfig chunkCache = ChunkCacheConfig::ForFile(*firstBax,
+                                                                          BaseCallsGroupName(),
+                                                                          BaseCallFields(),
+                                                                          settings_.hdf5CacheMB);
+            chunkCache.Apply(&fileAccess_);
+
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            inputStats_.numCachedDatasets = chunkCache.numDatasets;
+            inputStats_.chunkCacheBytes = chunkCache.bytesPerDataset;
+            inputStats_.chunkCacheSlots = chunkCache.numSlots;
+        } catch (std::exception& e) {
+            AddErrorMessage(std::string(e.what()));
+            return false;
+        }
+    }
+
     // initialize input BAX readers
     const auto baxEnd = settings_.inputBaxFilenames.cend();
     for (auto baxIter = settings_.inputBaxFilenames.cbegin(); baxIter != baxEnd; ++baxIter) {
@@ -862,7 +1461,7 @@ bool ConverterBase<RecordType, HdfReader>::Run(void)
         HdfReader* reader = InitHdfReader();
 
         // read in mandatory ReadGroupInfo from bax file
-        if (reader->Initialize(baxFn) &&
+        if (reader->Initialize(baxFn, fileAccess_) &&
             reader->scanDataReader.fileHasScanData &&
             reader->scanDataReader.initializedRunInfoGroup)
         {
@@ -960,6 +1559,13 @@ fallback:
         return false;
     }
     settings_.movieName = (*movieNames.cbegin());
+    recordNamePrefix_ = settings_.movieName + "/";
+    if (recordNamePrefix_.size() > ReadName::MaxPrefixLength) {
+        AddErrorMessage("movie name too long for BAM read names (at most " +
+                        std::to_string(ReadName::MaxPrefixLength - 1) + " characters): " +
+                        settings_.movieName);
+        return false;
+    }
 
     // Use the movie name to initialize the ReadGroupId
     settings_.readGroupId = MakeReadGroupId(MovieName(), HeaderReadType());
@@ -977,46 +1583,32 @@ fallback:
         settings_.scrapsBamFilename = settings_.outputBamPrefix + ScrapsFileSuffix();
 
         // main conversion of BAX -> BAM records for dual-output jobs
-        try {
-            BamWriter writer(settings_.outputBamFilename, CreateHeader(HeaderReadType()));
-            BamWriter scrapsWriter(settings_.scrapsBamFilename, CreateHeader(ScrapsReadType()));
-
-            for (HdfReader* reader : readers_) {
-                assert(reader);
-                if (!ConvertFile(reader, &writer, &scrapsWriter))
-                    return false;
-            }
-        } catch (std::exception&) {
-            // TODO: get more helpful message here
-            AddErrorMessage("failed to convert BAM file");
+        // (PBI files are written alongside)
+        if (!ConvertFiles(CreateHeader(HeaderReadType()), CreateHeader(ScrapsReadType())))
             return false;
-        }
-
-        // make PBI files
-        PbiFile::CreateFrom(BamFile{ settings_.outputBamFilename });
-        PbiFile::CreateFrom(BamFile{ settings_.scrapsBamFilename });
 
     } else {
 
         assert(settings_.scrapsBamFilename.empty());
 
         // main conversion of BAX -> BAM records for single-output jobs
-        try {
-            BamWriter writer(settings_.outputBamFilename, CreateHeader(HeaderReadType()));
+        // (PBI file is written alongside)
+        if (!ConvertFiles(CreateHeader(HeaderReadType()), BamHeader()))
+            return false;
+    }
 
-            for (HdfReader* reader : readers_) {
-                assert(reader);
-                if (!ConvertFile(reader, &writer))
-                    return false;
+    // chunk re-use, for the run report
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        for (const auto& batchReader : batchReaders_) {
+            if (batchReader) {
+                inputStats_.numChunkHits += batchReader->NumChunkHits();
+                inputStats_.numChunkMisses += batchReader->NumChunkMisses();
+                inputStats_.numZmwsSkipped += batchReader->NumZmwsSkipped();
             }
-        } catch (std::exception&) {
-            // TODO: get more helpful message here
-            AddErrorMessage("failed to convert BAM file");
-            return false;
         }
-
-        // make PBI file
-        PbiFile::CreateFrom(BamFile{ settings_.outputBamFilename });
+        inputStats_.numZmwsFiltered += numZmwsFiltered_;
+        inputStats_.numRecordsFiltered += numRecordsFiltered_;
     }
 
     // if we get here, return success
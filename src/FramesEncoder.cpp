@@ -0,0 +1,119 @@
+#include "FramesEncoder.h"
+
+#include <cassert>
+#include <cmath>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FRAMESENCODER_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace internal {
+
+// gathers load 4 bytes at each index, so keep 3 bytes past the last entry
+static const size_t GatherPadding = 3;
+
+#ifdef FRAMESENCODER_HAVE_AVX2
+
+__attribute__((target("avx2")))
+static void EncodeAvx2(const uint8_t* table,
+                       const uint32_t maxIndex,
+                       const uint16_t* frames,
+                       const size_t length,
+                       uint8_t* codes)
+{
+    const __m256i limit   = _mm256_set1_epi32(static_cast<int>(maxIndex));
+    const __m256i lowByte = _mm256_set1_epi32(0xFF);
+    const int* base = reinterpret_cast<const int*>(table);
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i f0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frames + i));
+        const __m128i f1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frames + i + 8));
+        const __m256i index0 = _mm256_min_epu32(_mm256_cvtepu16_epi32(f0), limit);
+        const __m256i index1 = _mm256_min_epu32(_mm256_cvtepu16_epi32(f1), limit);
+        const __m256i code0 = _mm256_and_si256(_mm256_i32gather_epi32(base, index0, 1), lowByte);
+        const __m256i code1 = _mm256_and_si256(_mm256_i32gather_epi32(base, index1, 1), lowByte);
+
+        // 2 x 8 x 32-bit -> 16 x 16-bit (packus works per 128-bit lane) -> 16 x 8-bit
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(code0, code1), 0xD8);
+        const __m128i result = _mm_packus_epi16(_mm256_castsi256_si128(packed),
+                                                _mm256_extracti128_si256(packed, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(codes + i), result);
+    }
+    for (; i < length; ++i)
+        codes[i] = table[std::min<uint32_t>(frames[i], maxIndex)];
+}
+
+#endif // FRAMESENCODER_HAVE_AVX2
+
+} // namespace internal
+
+FramesEncoder::FramesEncoder(const bool allowSimd)
+    : maxFramepoint_(0)
+    , useAvx2_(false)
+{
+    InitIpdDownsampling();
+
+#ifdef FRAMESENCODER_HAVE_AVX2
+    useAvx2_ = allowSimd && __builtin_cpu_supports("avx2");
+#else
+    (void)allowSimd;
+#endif
+}
+
+// Same framepoints & rounding as pbbam's (V1) codec: 4 runs of 64 codes, with
+// frame steps of 1, 2, 4 & 8. Frames round to the nearest framepoint.
+void FramesEncoder::InitIpdDownsampling(void)
+{
+    const int B = 2;
+    const int t = 6;
+    const double T = std::pow(B, t);
+
+    int next = 0;
+    const int end = 256 / T;
+    for (int i = 0; i < end; ++i) {
+        const double grain = std::pow(B, i);
+        for (double j = 0; j < T; ++j)
+            framepoints_.push_back(static_cast<uint16_t>(j * grain + next));
+        next = framepoints_.back() + grain;
+    }
+    assert(framepoints_.size()-1 <= UINT8_MAX);
+
+    maxFramepoint_ = framepoints_.back();
+    frameToCode_.assign(maxFramepoint_ + 2 + internal::GatherPadding, 0);
+
+    const int fpEnd = framepoints_.size() - 1;
+    int i = 0;
+    for (; i < fpEnd; ++i) {
+        const uint16_t fl = framepoints_[i];
+        const uint16_t fu = framepoints_[i+1];
+        if (fu > fl + 1) {
+            const int middle = (fl + fu) / 2;
+            for (int f = fl; f < middle; ++f)
+                frameToCode_[f] = i;
+            for (int f = middle; f < fu; ++f)
+                frameToCode_[f] = i+1;
+        } else
+            frameToCode_[fl] = i;
+    }
+    frameToCode_[maxFramepoint_] = i;
+
+    // anything above the last framepoint saturates
+    frameToCode_[maxFramepoint_ + 1] = 255;
+}
+
+void FramesEncoder::Encode(const uint16_t* frames,
+                           const size_t length,
+                           uint8_t* codes) const
+{
+#ifdef FRAMESENCODER_HAVE_AVX2
+    if (useAvx2_) {
+        internal::EncodeAvx2(frameToCode_.data(), maxFramepoint_ + 1u, frames, length, codes);
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < length; ++i)
+        codes[i] = CodeFromFrame(frames[i]);
+}
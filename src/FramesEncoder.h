@@ -0,0 +1,43 @@
+#ifndef FRAMESENCODER_H
+#define FRAMESENCODER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//
+// FramesEncoder downsamples 16-bit frame counts (IPD, PulseWidth) to the
+// 8-bit lossy codec (V1) stored in BAM, producing the same codes as pbbam's
+// Frames::Encode.
+//
+// The frame -> code table is built once, on construction. Encoding is a
+// table lookup per frame, vectorized with AVX2 gathers where the CPU
+// supports it (and 'allowSimd' is set), and writes straight into the
+// caller's buffer.
+//
+class FramesEncoder
+{
+public:
+    explicit FramesEncoder(const bool allowSimd = true);
+
+public:
+    // Encodes 'length' frames into 'codes' (which must hold 'length' bytes).
+    void Encode(const uint16_t* frames, const size_t length, uint8_t* codes) const;
+
+    uint8_t CodeFromFrame(const uint16_t frame) const;
+
+private:
+    void InitIpdDownsampling(void);
+
+private:
+    std::vector<uint16_t> framepoints_;
+    std::vector<uint8_t> frameToCode_;      // frames 0..maxFramepoint_, then the overflow code (255)
+    uint16_t maxFramepoint_;
+    bool useAvx2_;
+};
+
+inline uint8_t FramesEncoder::CodeFromFrame(const uint16_t frame) const
+{ return frameToCode_[std::min<uint32_t>(frame, maxFramepoint_ + 1u)]; }
+
+#endif // FRAMESENCODER_H
@@ -20,160 +20,189 @@ HqRegionConverter::HqRegionConverter(Settings& settings)
 
 HqRegionConverter::~HqRegionConverter(void) { }
 
-bool HqRegionConverter::ConvertFile(HDFBasReader* reader,
-                                    PacBio::BAM::BamWriter* writer)
-{
-    return ConvertFile(reader, writer, nullptr);
-}
-
-bool HqRegionConverter::ConvertFile(HDFBasReader* reader,
-                                    PacBio::BAM::BamWriter* writer,
-                                    PacBio::BAM::BamWriter* scrapsWriter)
+bool HqRegionConverter::InitFile(HDFBasReader* reader, const size_t fileIndex)
 {
     assert(reader);
 
     // read region table info
     std::unique_ptr<HDFRegionTableReader> const regionTableReader(new HDFRegionTableReader);
-    RegionTable regionTable;
     std::string fn = filenameForReader_[reader];
     assert(!fn.empty());
-    if (regionTableReader->Initialize(fn) == 0) {
+    if (regionTableReader->Initialize(fn, fileAccess_) == 0) {
         AddErrorMessage("could not read region table on "+fn);
         return false;
     }
-    regionTable.Reset();
+    RegionTable regionTable;
     regionTableReader->ReadTable(regionTable);
     regionTableReader->Close();
 
+    // flatten it, for per-ZMW lookups without copies
+    std::vector<UInt> holeNumbers;
+    ReadHoleNumbers(reader, &holeNumbers);
+    if (regionIndices_.size() <= fileIndex)
+        regionIndices_.resize(fileIndex + 1);
+    regionIndices_.at(fileIndex).Build(regionTable, holeNumbers);
+
     // initialize read scores
-    InitReadScores(reader);
-
-    // fetch records from HDF5 file
-    SMRTSequence smrtRecord;
-    int hqStart, hqEnd, score;
-    while (reader->GetNext(smrtRecord)) {
-
-        // attempt get high quality region
-        if (!LookupHQRegion(smrtRecord.zmwData.holeNumber,
-                            regionTable,
-                            hqStart,
-                            hqEnd,
-                            score))
+    return ConverterBase::InitFile(reader, fileIndex);
+}
+
+bool HqRegionConverter::PassesFilters(const ZmwSummary& zmw) const
+{
+    if (!ConverterBase::PassesFilters(zmw))
+        return false;
+    if (settings_.minHqLength == 0)
+        return true;
+
+    const RegionIndex::ZmwRegions zmwRegions =
+            regionIndices_.at(zmw.fileIndex).Find(zmw.holeNumber);
+    if (!zmwRegions.found)
+        return true;    // reported when converted
+    return RegionIndex::HqLength(zmwRegions, zmw.readLength) >= settings_.minHqLength;
+}
+
+bool HqRegionConverter::EmitsRecords(const ZmwSummary& zmw)
+{
+    // same decisions as ConvertZmw(), without the bases
+    const RegionIndex::ZmwRegions zmwRegions =
+            regionIndices_.at(zmw.fileIndex).Find(zmw.holeNumber);
+    if (!zmwRegions.found)
+        return true;    // reported when converted
+
+    const int hqStart = zmwRegions.hqRegion.start;
+    int hqEnd = zmwRegions.hqRegion.end;
+    hqEnd = (hqEnd == static_cast<int>(zmw.readLength)-1) ? zmw.readLength
+                                                          : hqEnd;
+    const bool hasLowQuality = (hqStart > 0) || (static_cast<size_t>(hqEnd) < zmw.readLength);
+    const bool hasScraps = !settings_.scrapsBamFilename.empty();
+
+    if (IsSequencingZmw(zmw.holeStatus))
+        return (hqStart < hqEnd) || (hasScraps && hasLowQuality);
+    return settings_.isInternal && hasScraps && ((hqStart < hqEnd) || hasLowQuality);
+}
+
+bool HqRegionConverter::ConvertZmw(const SMRTSequence& smrtRecord,
+                                   ConversionContext* context,
+                                   RecordBuffer* records,
+                                   RecordBuffer* scraps)
+{
+    // attempt get high quality region
+    const RegionIndex::ZmwRegions zmwRegions =
+            regionIndices_.at(context->fileIndex).Find(smrtRecord.zmwData.holeNumber);
+    if (!zmwRegions.found)
+    {
+        std::stringstream s;
+        s << "could not find HQ region for hole number: " << smrtRecord.zmwData.holeNumber;
+        AddErrorMessage(s.str());
+        return false;
+    }
+    const int hqStart = zmwRegions.hqRegion.start;
+    int hqEnd = zmwRegions.hqRegion.end;
+
+    // Catch and repair 1-off errors in the HQ region
+    hqEnd = (hqEnd == static_cast<int>(smrtRecord.length)-1) ? smrtRecord.length
+                                                             : hqEnd;
+
+    // sequencing ZMW
+    if (IsSequencingZmw(smrtRecord))
+    {
+        // write HQRegion to main BAM file
+        if (hqStart < hqEnd)
         {
-            std::stringstream s;
-            s << "could not find HQ region for hole number: " << smrtRecord.zmwData.holeNumber;
-            AddErrorMessage(s.str());
-            smrtRecord.Free();
-            return false;
+            if (!WriteRecord(smrtRecord,
+                             hqStart,
+                             hqEnd,
+                             ReadGroupId(),
+                             context,
+                             records))
+            {
+                return false;
+            }
         }
 
-        // Catch and repair 1-off errors in the HQ region
-        hqEnd = (hqEnd == static_cast<int>(smrtRecord.length)-1) ? smrtRecord.length
-                                                                 : hqEnd;
-
-        // sequencing ZMW
-        if (IsSequencingZmw(smrtRecord))
+        // if scraps BAM file present
+        if (scraps)
         {
-            // write HQRegion to main BAM file
-            if (hqStart < hqEnd)
+            // write 5'-end LQ sequence
+            if (hqStart > 0)
             {
-                if (!WriteRecord(smrtRecord,
-                                 hqStart,
-                                 hqEnd,
-                                 ReadGroupId(),
-                                 writer))
+                if (!WriteLowQualityRecord(smrtRecord,
+                                           0,
+                                           hqStart,
+                                           ScrapsReadGroupId(),
+                                           context,
+                                           scraps))
                 {
-                    smrtRecord.Free();
                     return false;
                 }
             }
 
-            // if scraps BAM file present
-            if (scrapsWriter)
+            // write 3'-end LQ sequence
+            if (static_cast<size_t>(hqEnd) < smrtRecord.length)
             {
-                // write 5'-end LQ sequence
-                if (hqStart > 0)
-                {
-                    if (!WriteLowQualityRecord(smrtRecord,
-                                               0,
-                                               hqStart,
-                                               ScrapsReadGroupId(),
-                                               scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
-                }
-
-                // write 3'-end LQ sequence
-                if (static_cast<size_t>(hqEnd) < smrtRecord.length)
+                if (!WriteLowQualityRecord(smrtRecord,
+                                           hqEnd,
+                                           smrtRecord.length,
+                                           ScrapsReadGroupId(),
+                                           context,
+                                           scraps))
                 {
-                    if (!WriteLowQualityRecord(smrtRecord,
-                                               hqEnd,
-                                               smrtRecord.length,
-                                               ScrapsReadGroupId(),
-                                               scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
+                    return false;
                 }
             }
         }
+    }
 
-        // non-sequencing ZMW
-        else
-        {
-            assert(!IsSequencingZmw(smrtRecord));
+    // non-sequencing ZMW
+    else
+    {
+        assert(!IsSequencingZmw(smrtRecord));
 
-            // only write these if scraps BAM present & we are in 'internal mode'
-            if (settings_.isInternal && scrapsWriter)
+        // only write these if scraps BAM present & we are in 'internal mode'
+        if (settings_.isInternal && scraps)
+        {
+            // write 5'-end LQ sequence
+            if (hqStart > 0)
             {
-                // write 5'-end LQ sequence
-                if (hqStart > 0)
+                if (!WriteLowQualityRecord(smrtRecord,
+                                           0,
+                                           hqStart,
+                                           ScrapsReadGroupId(),
+                                           context,
+                                           scraps))
                 {
-                    if (!WriteLowQualityRecord(smrtRecord,
-                                               0,
-                                               hqStart,
-                                               ScrapsReadGroupId(),
-                                               scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
+                    return false;
                 }
+            }
 
-                // write HQRegion to scraps BAM file
-                if (hqStart < hqEnd)
+            // write HQRegion to scraps BAM file
+            if (hqStart < hqEnd)
+            {
+                if (!WriteFilteredRecord(smrtRecord,
+                                         hqStart,
+                                         hqEnd,
+                                         ScrapsReadGroupId(),
+                                         context,
+                                         scraps))
                 {
-                    if (!WriteFilteredRecord(smrtRecord,
-                                             hqStart,
-                                             hqEnd,
-                                             ScrapsReadGroupId(),
-                                             scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
+                    return false;
                 }
+            }
 
-                // write 3'-end LQ sequence
-                if (static_cast<size_t>(hqEnd) < smrtRecord.length)
+            // write 3'-end LQ sequence
+            if (static_cast<size_t>(hqEnd) < smrtRecord.length)
+            {
+                if (!WriteLowQualityRecord(smrtRecord,
+                                           hqEnd,
+                                           smrtRecord.length,
+                                           ScrapsReadGroupId(),
+                                           context,
+                                           scraps))
                 {
-                    if (!WriteLowQualityRecord(smrtRecord,
-                                               hqEnd,
-                                               smrtRecord.length,
-                                               ScrapsReadGroupId(),
-                                               scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
+                    return false;
                 }
             }
         }
-
-        smrtRecord.Free();
     }
 
     // if we get here, all OK
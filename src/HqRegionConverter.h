@@ -4,6 +4,7 @@
 #define HQREGIONCONVERTER_H
 
 #include "ConverterBase.h"
+#include "RegionIndex.h"
 
 class HqRegionConverter : public ConverterBase<>
 {
@@ -12,15 +13,20 @@ public:
     ~HqRegionConverter(void);
 
 protected:
-    bool ConvertFile(HDFBasReader* reader,
-                     PacBio::BAM::BamWriter* writer);
-    bool ConvertFile(HDFBasReader* reader,
-                     PacBio::BAM::BamWriter* writer,
-                     PacBio::BAM::BamWriter* scrapsWriter);
+    bool InitFile(HDFBasReader* reader, const size_t fileIndex);
+    bool PassesFilters(const ZmwSummary& zmw) const;
+    bool EmitsRecords(const ZmwSummary& zmw);
+    bool ConvertZmw(const SMRTSequence& smrtRecord,
+                    ConversionContext* context,
+                    RecordBuffer* records,
+                    RecordBuffer* scraps);
     std::string HeaderReadType(void) const;
     std::string ScrapsReadType(void) const;
     std::string OutputFileSuffix(void) const;
     std::string ScrapsFileSuffix(void) const;
+
+protected:
+    std::vector<RegionIndex> regionIndices_;   // per input file
 };
 
 #endif // HQREGIONCONVERTER_H
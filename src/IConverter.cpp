@@ -1,6 +1,7 @@
 // Author: Derek Barnett
 
 #include "IConverter.h"
+#include "ZmwSelection.h"
 #include <pbbam/BamRecord.h>
 #include <algorithm>
 #include <iostream>
@@ -11,6 +12,8 @@
 using namespace PacBio;
 using namespace PacBio::BAM;
 
+std::mutex IConverter::hdfMutex_;
+
 IConverter::IConverter(Settings& settings)
     : settings_(settings)
 { }
@@ -18,7 +21,51 @@ IConverter::IConverter(Settings& settings)
 IConverter::~IConverter(void) { }
 
 void IConverter::AddErrorMessage(const std::string& e)
-{ errors_.push_back(e); }
+{
+    std::lock_guard<std::mutex> lock(errorsMutex_);
+    errors_.push_back(e);
+}
+
+void IConverter::AddOutputStats(const OutputStats& main, const OutputStats& scraps)
+{
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    mainStats_.numRecords    += main.numRecords;
+    mainStats_.totalLength   += main.totalLength;
+    scrapsStats_.numRecords  += scraps.numRecords;
+    scrapsStats_.totalLength += scraps.totalLength;
+
+    // compression
+    mainStats_.compressSeconds   += main.compressSeconds;
+    mainStats_.writeSeconds      += main.writeSeconds;
+    scrapsStats_.compressSeconds += scraps.compressSeconds;
+    scrapsStats_.writeSeconds    += scraps.writeSeconds;
+    if (mainStats_.bytesAtLevel.size() < main.bytesAtLevel.size())
+        mainStats_.bytesAtLevel.resize(main.bytesAtLevel.size(), 0);
+    for (size_t i = 0; i < main.bytesAtLevel.size(); ++i)
+        mainStats_.bytesAtLevel[i] += main.bytesAtLevel[i];
+    if (scrapsStats_.bytesAtLevel.size() < scraps.bytesAtLevel.size())
+        scrapsStats_.bytesAtLevel.resize(scraps.bytesAtLevel.size(), 0);
+    for (size_t i = 0; i < scraps.bytesAtLevel.size(); ++i)
+        scrapsStats_.bytesAtLevel[i] += scraps.bytesAtLevel[i];
+}
+
+IConverter::OutputStats IConverter::MainOutputStats(void) const
+{
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    return mainStats_;
+}
+
+IConverter::OutputStats IConverter::ScrapsOutputStats(void) const
+{
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    return scrapsStats_;
+}
+
+IConverter::InputStats IConverter::InputStatistics(void) const
+{
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    return inputStats_;
+}
 
 BamHeader IConverter::CreateHeader(const std::string& modeString)
 {
@@ -71,8 +118,20 @@ BamHeader IConverter::CreateHeader(const std::string& modeString)
            .Version(settings_.version);
     header.AddProgram(program);
 
+    // @CO <program> ZMW selection: <tags>
+    const std::vector<std::string> selectionTags = ZmwSelection(settings_).Tags();
+    if (!selectionTags.empty()) {
+        std::string comment = settings_.program + " ZMW selection:";
+        for (const std::string& tag : selectionTags)
+            comment += " " + tag;
+        header.AddComment(comment);
+    }
+
     return header;
 }
 
 std::vector<std::string> IConverter::Errors(void) const
-{ return errors_; }
+{
+    std::lock_guard<std::mutex> lock(errorsMutex_);
+    return errors_;
+}
@@ -3,7 +3,9 @@
 #ifndef ICONVERTER_H
 #define ICONVERTER_H
 
+#include <cstdint>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -23,6 +25,49 @@ class BamRecordImpl;
 
 class IConverter
 {
+public:
+    // Number of records & total read length written to an output BAM file.
+    struct OutputStats
+    {
+        uint64_t numRecords;
+        uint64_t totalLength;
+        std::vector<uint64_t> bytesAtLevel; // uncompressed, per deflate level
+        double compressSeconds;             // over all threads
+        double writeSeconds;
+
+        OutputStats(void)
+            : numRecords(0)
+            , totalLength(0)
+            , compressSeconds(0.0)
+            , writeSeconds(0.0)
+        { }
+    };
+
+    // HDF5 chunk cache settings & usage, and ZMWs & records not converted,
+    // over all input files.
+    struct InputStats
+    {
+        size_t numCachedDatasets;
+        size_t chunkCacheBytes;     // per dataset, 0 for the HDF5 default
+        size_t chunkCacheSlots;
+        uint64_t numChunkHits;      // chunks re-used by the batch reader
+        uint64_t numChunkMisses;    // chunks read directly by the batch reader
+        uint64_t numZmwsSkipped;    // not read, as they would write nothing (filtered included)
+        uint64_t numZmwsFiltered;   // dropped by --min-rq or --min-hq-length
+        uint64_t numRecordsFiltered;// dropped by --min-subread-length
+
+        InputStats(void)
+            : numCachedDatasets(0)
+            , chunkCacheBytes(0)
+            , chunkCacheSlots(0)
+            , numChunkHits(0)
+            , numChunkMisses(0)
+            , numZmwsSkipped(0)
+            , numZmwsFiltered(0)
+            , numRecordsFiltered(0)
+        { }
+    };
+
 public:
     virtual ~IConverter(void);
 
@@ -30,10 +75,16 @@ public:
     virtual std::vector<std::string> Errors(void) const final;
     virtual bool Run(void) =0;
 
+    // valid after a successful Run()
+    virtual OutputStats MainOutputStats(void) const final;
+    virtual OutputStats ScrapsOutputStats(void) const final;
+    virtual InputStats InputStatistics(void) const final;
+
 protected:
     IConverter(Settings& settings);
 
     virtual void AddErrorMessage(const std::string& e) final;
+    virtual void AddOutputStats(const OutputStats& main, const OutputStats& scraps) final;
 
     virtual PacBio::BAM::BamHeader CreateHeader(const std::string& modeString) final;
 
@@ -44,6 +95,14 @@ protected:
     // common state
     Settings& settings_;
     std::vector<std::string> errors_;
+    mutable std::mutex errorsMutex_;   // errors may be reported from worker threads
+    OutputStats mainStats_;
+    OutputStats scrapsStats_;
+    InputStats inputStats_;
+    mutable std::mutex statsMutex_;    // parts may be written concurrently
+
+    // serializes HDF5 library calls (HDF5 is not built thread-safe)
+    static std::mutex hdfMutex_;
 
     // run info for BamHeader creation
     std::string bindingKit_;
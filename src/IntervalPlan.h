@@ -0,0 +1,31 @@
+#ifndef INTERVALPLAN_H
+#define INTERVALPLAN_H
+
+#include <cstdint>
+#include <vector>
+
+//
+// The pieces a ZMW's read is split into (low-quality ends, subreads,
+// adapters), in query order.
+//
+// Plans are cleared & re-filled for every ZMW, keeping their capacity, so
+// steady-state planning does not allocate.
+//
+struct PlannedInterval
+{
+    enum Type
+    {
+        LowQuality,
+        Subread,
+        Adapter
+    };
+
+    Type type;
+    int start;
+    int end;
+    uint8_t contextFlags;     // LocalContextFlags, subreads only
+};
+
+typedef std::vector<PlannedInterval> IntervalPlan;
+
+#endif // INTERVALPLAN_H
@@ -0,0 +1,53 @@
+#include "OptionParser.h"
+#include "ShardMerge.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
+int main(int argc, char* argv[])
+{
+    // setup help & options
+    optparse::OptionParser parser;
+    parser.description("bax2bam-merge joins the outputs of a sharded bax2bam conversion "
+                       "(--shard i/n), without decompressing them. Given BAM files, it writes "
+                       "one BAM & PBI file. Given dataset XML files, it joins the main & scraps "
+                       "BAM files they list, and writes the combined dataset XML.");
+    parser.prog("bax2bam-merge");
+    parser.usage("bax2bam-merge -o <output.bam> <shard BAM files, in order>\n"
+                 "       bax2bam-merge -o <output prefix> <shard dataset XML files, in order>");
+    parser.version("0.0.11");
+    parser.add_version_option(true);
+    parser.add_help_option(true);
+
+    parser.add_option("-o")
+          .dest("output")
+          .metavar("STRING")
+          .help("Output BAM file name (given BAM files) or prefix (given dataset XML "
+                "files). The PBI index is written alongside.");
+
+    const optparse::Values options = parser.parse_args(argc, argv);
+    const std::vector<std::string> inputs(parser.args().cbegin(), parser.args().cend());
+    const std::string output = options["output"];
+    if (output.empty() || inputs.empty()) {
+        std::cerr << std::endl
+                  << "ERROR: an output and at least one input file are required" << std::endl
+                  << std::endl;
+        parser.print_help();
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (boost::iends_with(inputs.front(), ".xml"))
+            ShardMerge::MergeDatasets(inputs, output);
+        else
+            ShardMerge::MergeBams(inputs, output);
+    } catch (std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
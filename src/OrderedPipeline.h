@@ -0,0 +1,307 @@
+#ifndef ORDEREDPIPELINE_H
+#define ORDEREDPIPELINE_H
+
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// OrderedPipeline runs a fill -> process -> commit loop over a fixed set of
+// re-usable batches:
+//
+//   fill    - runs on a single (reader) thread, loads the next batch of input.
+//             Returns false when no more input is available.
+//   process - runs on one of N worker threads, converts a filled batch.
+//             Receives the index of the worker, for access to per-worker state.
+//             With no workers, runs on the calling thread (as worker 0), in
+//             fill order, before the batch is committed.
+//   commit  - runs on the calling thread, strictly in fill order.
+//
+// The reader runs ahead of the workers as long as a free batch is available,
+// so the number of batches bounds the read-ahead. SetMemoryLimit() further
+// caps the size of filled batches waiting for a worker.
+//
+// With a single batch, everything runs inline on the calling thread, in the
+// same order as a plain loop would. Any stage returning false stops the
+// pipeline and makes Run() return false. A stage throwing stops it too, and
+// Run() rethrows the first exception (on the calling thread, once all
+// threads are done).
+//
+template<typename Batch>
+class OrderedPipeline
+{
+public:
+    typedef std::function<bool(Batch*)>         FillFunction;
+    typedef std::function<bool(Batch*, size_t)> ProcessFunction;
+    typedef std::function<bool(Batch*)>         CommitFunction;
+    typedef std::function<size_t(const Batch&)> SizeFunction;
+
+public:
+    OrderedPipeline(std::vector<Batch>* batches, const size_t numWorkers);
+
+public:
+    // The reader does not fill another batch while the filled batches waiting
+    // for a worker add up to 'maxQueuedBytes' (as measured by 'size') or more.
+    // At least one batch is always allowed to wait. 0 means no limit.
+    void SetMemoryLimit(const size_t maxQueuedBytes, const SizeFunction& size);
+
+    bool Run(const FillFunction& fill,
+             const ProcessFunction& process,
+             const CommitFunction& commit);
+
+private:
+    bool RunSerial(const FillFunction& fill,
+                   const ProcessFunction& process,
+                   const CommitFunction& commit);
+
+    bool RunParallel(const FillFunction& fill,
+                     const ProcessFunction& process,
+                     const CommitFunction& commit);
+
+    void ReaderLoop(const FillFunction& fill);
+    void WorkerLoop(const ProcessFunction& process, const size_t workerIndex);
+    void Fail(std::exception_ptr error = nullptr);
+
+private:
+    std::vector<Batch>* batches_;
+    size_t numWorkers_;
+    size_t maxQueuedBytes_;
+    SizeFunction size_;
+
+    // shared state, guarded by mutex_
+    std::mutex mutex_;
+    std::condition_variable freeReady_;
+    std::condition_variable workReady_;
+    std::condition_variable doneReady_;
+    std::vector<Batch*> free_;
+    std::map<size_t, Batch*> work_;     // filled, waiting for a worker (by sequence number)
+    std::map<size_t, Batch*> done_;     // processed, waiting for commit (by sequence number)
+    size_t numFilled_;
+    size_t queuedBytes_;                // size of batches in work_
+    bool readerDone_;
+    bool failed_;
+    std::exception_ptr error_;          // first thrown by a stage
+};
+
+template<typename Batch>
+OrderedPipeline<Batch>::OrderedPipeline(std::vector<Batch>* batches,
+                                        const size_t numWorkers)
+    : batches_(batches)
+    , numWorkers_(numWorkers)
+    , maxQueuedBytes_(0)
+    , numFilled_(0)
+    , queuedBytes_(0)
+    , readerDone_(false)
+    , failed_(false)
+{
+    assert(batches_);
+    assert(!batches_->empty());
+}
+
+template<typename Batch>
+void OrderedPipeline<Batch>::SetMemoryLimit(const size_t maxQueuedBytes,
+                                            const SizeFunction& size)
+{
+    maxQueuedBytes_ = maxQueuedBytes;
+    size_ = size;
+}
+
+template<typename Batch>
+bool OrderedPipeline<Batch>::Run(const FillFunction& fill,
+                                 const ProcessFunction& process,
+                                 const CommitFunction& commit)
+{
+    if (batches_->size() == 1)
+        return RunSerial(fill, process, commit);
+    return RunParallel(fill, process, commit);
+}
+
+template<typename Batch>
+bool OrderedPipeline<Batch>::RunSerial(const FillFunction& fill,
+                                       const ProcessFunction& process,
+                                       const CommitFunction& commit)
+{
+    Batch* batch = &batches_->front();
+    while (fill(batch)) {
+        if (!process(batch, 0) || !commit(batch))
+            return false;
+    }
+    return true;
+}
+
+template<typename Batch>
+bool OrderedPipeline<Batch>::RunParallel(const FillFunction& fill,
+                                         const ProcessFunction& process,
+                                         const CommitFunction& commit)
+{
+    for (Batch& batch : *batches_)
+        free_.push_back(&batch);
+
+    std::thread reader(&OrderedPipeline<Batch>::ReaderLoop, this, std::cref(fill));
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < numWorkers_; ++i)
+        workers.emplace_back(&OrderedPipeline<Batch>::WorkerLoop, this, std::cref(process), i);
+
+    // commit batches in fill order (processing them first, without workers)
+    std::map<size_t, Batch*>& ready = (numWorkers_ == 0 ? work_ : done_);
+    size_t next = 0;
+    while (true) {
+        Batch* batch = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            doneReady_.wait(lock, [&]() {
+                return failed_ ||
+                       ready.count(next) != 0 ||
+                       (readerDone_ && next == numFilled_);
+            });
+            if (failed_ || ready.count(next) == 0)
+                break;
+            batch = ready[next];
+            ready.erase(next);
+            if (numWorkers_ == 0 && maxQueuedBytes_ > 0)
+                queuedBytes_ -= size_(*batch);
+        }
+        if (numWorkers_ == 0 && maxQueuedBytes_ > 0)
+            freeReady_.notify_one();
+
+        bool ok = false;
+        try {
+            ok = (numWorkers_ > 0 || process(batch, 0)) && commit(batch);
+        } catch (...) {
+            Fail(std::current_exception());
+            break;
+        }
+        if (!ok) {
+            Fail();
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_.push_back(batch);
+        }
+        freeReady_.notify_one();
+        ++next;
+    }
+
+    reader.join();
+    for (std::thread& worker : workers)
+        worker.join();
+
+    if (error_)
+        std::rethrow_exception(error_);
+    return !failed_;
+}
+
+template<typename Batch>
+void OrderedPipeline<Batch>::ReaderLoop(const FillFunction& fill)
+{
+    while (true) {
+        Batch* batch = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            freeReady_.wait(lock, [&]() {
+                return failed_ ||
+                       (!free_.empty() &&
+                        (maxQueuedBytes_ == 0 || work_.empty() || queuedBytes_ < maxQueuedBytes_));
+            });
+            if (failed_)
+                break;
+            batch = free_.back();
+            free_.pop_back();
+        }
+
+        bool hasData = false;
+        try {
+            hasData = fill(batch);
+        } catch (...) {
+            Fail(std::current_exception());
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!hasData) {
+                free_.push_back(batch);
+                break;
+            }
+            if (maxQueuedBytes_ > 0)
+                queuedBytes_ += size_(*batch);
+            work_[numFilled_++] = batch;
+        }
+        if (numWorkers_ == 0)
+            doneReady_.notify_all();
+        else
+            workReady_.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        readerDone_ = true;
+    }
+    workReady_.notify_all();
+    doneReady_.notify_all();
+}
+
+template<typename Batch>
+void OrderedPipeline<Batch>::WorkerLoop(const ProcessFunction& process,
+                                        const size_t workerIndex)
+{
+    while (true) {
+        size_t sequence = 0;
+        Batch* batch = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            workReady_.wait(lock, [&]() { return failed_ || readerDone_ || !work_.empty(); });
+            if (failed_ || work_.empty())
+                break;
+            sequence = work_.begin()->first;
+            batch = work_.begin()->second;
+            work_.erase(work_.begin());
+            if (maxQueuedBytes_ > 0)
+                queuedBytes_ -= size_(*batch);
+        }
+        if (maxQueuedBytes_ > 0)
+            freeReady_.notify_one();    // reader may be waiting for queue space
+
+        bool ok = false;
+        try {
+            ok = process(batch, workerIndex);
+        } catch (...) {
+            Fail(std::current_exception());
+            break;
+        }
+        if (!ok) {
+            Fail();
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_[sequence] = batch;
+        }
+        doneReady_.notify_all();
+    }
+}
+
+template<typename Batch>
+void OrderedPipeline<Batch>::Fail(std::exception_ptr error)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_ = true;
+        if (error && !error_)
+            error_ = error;
+    }
+    freeReady_.notify_all();
+    workReady_.notify_all();
+    doneReady_.notify_all();
+}
+
+#endif // ORDEREDPIPELINE_H
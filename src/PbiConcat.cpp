@@ -0,0 +1,49 @@
+#include "PbiConcat.h"
+#include "PbiWriter.h"
+
+#include <stdexcept>
+
+#include <pbbam/PbiFile.h>
+#include <pbbam/PbiRawData.h>
+
+namespace internal {
+
+template<typename T>
+static
+void Append(std::vector<T>* dst, const std::vector<T>& src)
+{ dst->insert(dst->end(), src.cbegin(), src.cend()); }
+
+} // namespace internal
+
+void PbiConcat::Concatenate(const std::vector<std::string>& inputPbiFilenames,
+                            const std::vector<BgzfConcat::Segment>& segments,
+                            const std::string& outputPbiFilename)
+{
+    using namespace PacBio::BAM;
+
+    if (inputPbiFilenames.empty() || inputPbiFilenames.size() != segments.size())
+        throw std::runtime_error("PBI files do not match BAM segments for "+outputPbiFilename);
+
+    // gather basic columns, rebasing file offsets into the combined BAM
+    PbiRawBasicData merged;
+    uint32_t version = PbiFile::CurrentVersion;
+    for (size_t i = 0; i < inputPbiFilenames.size(); ++i) {
+        const PbiRawData part(inputPbiFilenames.at(i));
+        if (part.FileSections() != PbiFile::BASIC)
+            throw std::runtime_error("unsupported PBI sections in "+inputPbiFilenames.at(i));
+        if (i == 0)
+            version = static_cast<uint32_t>(part.Version());
+
+        const PbiRawBasicData& basic = part.BasicData();
+        internal::Append(&merged.rgId_,       basic.rgId_);
+        internal::Append(&merged.qStart_,     basic.qStart_);
+        internal::Append(&merged.qEnd_,       basic.qEnd_);
+        internal::Append(&merged.holeNumber_, basic.holeNumber_);
+        internal::Append(&merged.readQual_,   basic.readQual_);
+        internal::Append(&merged.ctxtFlag_,   basic.ctxtFlag_);
+        for (const int64_t offset : basic.fileOffset_)
+            merged.fileOffset_.push_back(BgzfConcat::RebaseVirtualOffset(offset, segments.at(i)));
+    }
+
+    PbiWriter::Write(merged, version, outputPbiFilename);
+}
@@ -0,0 +1,26 @@
+#ifndef PBICONCAT_H
+#define PBICONCAT_H
+
+#include <string>
+#include <vector>
+
+#include "BgzfConcat.h"
+
+//
+// PbiConcat joins the PBI indices of BAM files that were combined with
+// BgzfConcat, rebasing each record's file offset into the combined BAM.
+//
+// Only the basic section is supported (unaligned, unbarcoded input), which
+// covers everything bax2bam writes.
+//
+// Throws std::runtime_error on failure.
+//
+class PbiConcat
+{
+public:
+    static void Concatenate(const std::vector<std::string>& inputPbiFilenames,
+                            const std::vector<BgzfConcat::Segment>& segments,
+                            const std::string& outputPbiFilename);
+};
+
+#endif // PBICONCAT_H
@@ -0,0 +1,67 @@
+#include "PbiWriter.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <htslib/bgzf.h>
+
+#include <pbbam/PbiFile.h>
+
+namespace internal {
+
+static
+void WriteBgzfData(BGZF* fp, const void* data, const size_t numBytes, const std::string& fn)
+{
+    if (numBytes > 0 && bgzf_write(fp, data, numBytes) != static_cast<ssize_t>(numBytes))
+        throw std::runtime_error("could not write to "+fn);
+}
+
+template<typename T>
+static
+void WriteBgzfVector(BGZF* fp, const std::vector<T>& data, const std::string& fn)
+{
+    // NOTE - PBI is little-endian, as is every platform we build on
+    WriteBgzfData(fp, data.data(), data.size() * sizeof(T), fn);
+}
+
+} // namespace internal
+
+void PbiWriter::Write(const PacBio::BAM::PbiRawBasicData& basicData,
+                      const uint32_t version,
+                      const std::string& pbiFilename)
+{
+    using namespace PacBio::BAM;
+
+    BGZF* fp = bgzf_open(pbiFilename.c_str(), "wb");
+    if (fp == nullptr)
+        throw std::runtime_error("could not open "+pbiFilename+" for writing");
+
+    try {
+        // header
+        const uint16_t sections = PbiFile::BASIC;
+        const uint32_t numReads = static_cast<uint32_t>(basicData.fileOffset_.size());
+        char reserved[18];
+        memset(reserved, 0, sizeof(reserved));
+        internal::WriteBgzfData(fp, "PBI\1", 4, pbiFilename);
+        internal::WriteBgzfData(fp, &version, sizeof(version), pbiFilename);
+        internal::WriteBgzfData(fp, &sections, sizeof(sections), pbiFilename);
+        internal::WriteBgzfData(fp, &numReads, sizeof(numReads), pbiFilename);
+        internal::WriteBgzfData(fp, reserved, sizeof(reserved), pbiFilename);
+
+        // basic data
+        internal::WriteBgzfVector(fp, basicData.rgId_,       pbiFilename);
+        internal::WriteBgzfVector(fp, basicData.qStart_,     pbiFilename);
+        internal::WriteBgzfVector(fp, basicData.qEnd_,       pbiFilename);
+        internal::WriteBgzfVector(fp, basicData.holeNumber_, pbiFilename);
+        internal::WriteBgzfVector(fp, basicData.readQual_,   pbiFilename);
+        internal::WriteBgzfVector(fp, basicData.ctxtFlag_,   pbiFilename);
+        internal::WriteBgzfVector(fp, basicData.fileOffset_, pbiFilename);
+    } catch (std::exception&) {
+        bgzf_close(fp);
+        throw;
+    }
+
+    if (bgzf_close(fp) != 0)
+        throw std::runtime_error("could not write to "+pbiFilename);
+}
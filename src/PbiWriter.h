@@ -0,0 +1,23 @@
+#ifndef PBIWRITER_H
+#define PBIWRITER_H
+
+#include <cstdint>
+#include <string>
+
+#include <pbbam/PbiRawData.h>
+
+//
+// PbiWriter saves the basic section of a PBI index (unaligned, unbarcoded
+// data - everything bax2bam writes).
+//
+// Throws std::runtime_error on failure.
+//
+class PbiWriter
+{
+public:
+    static void Write(const PacBio::BAM::PbiRawBasicData& basicData,
+                      const uint32_t version,
+                      const std::string& pbiFilename);
+};
+
+#endif // PBIWRITER_H
@@ -10,41 +10,22 @@ PolymeraseReadConverter::PolymeraseReadConverter(Settings& settings)
 
 PolymeraseReadConverter::~PolymeraseReadConverter(void) { }
 
-bool PolymeraseReadConverter::ConvertFile(HDFBasReader* reader,
-                                          PacBio::BAM::BamWriter* writer)
-{
-    assert(reader);
-
-    // initialize read scores
-    InitReadScores(reader);
-
-    // fetch records from HDF5 file
-    SMRTSequence smrtRecord;
-    while (reader->GetNext(smrtRecord)) {
-
-        // Skip empty records
-        if ((smrtRecord.length == 0) || !IsSequencingZmw(smrtRecord))
-            continue;
+bool PolymeraseReadConverter::EmitsRecords(const ZmwSummary& zmw)
+{ return (zmw.readLength > 0) && IsSequencingZmw(zmw.holeStatus); }
 
-        // attempt convert BAX to BAM
-        if (!WriteRecord(smrtRecord, 0, smrtRecord.length, ReadGroupId(), writer))
-        {
-            smrtRecord.Free();
-            return false;
-        }
-
-        smrtRecord.Free();
-    }
+bool PolymeraseReadConverter::ConvertZmw(const SMRTSequence& smrtRecord,
+                                         ConversionContext* context,
+                                         RecordBuffer* records,
+                                         RecordBuffer* scraps)
+{
+    // Skip empty records
+    if ((smrtRecord.length == 0) || !IsSequencingZmw(smrtRecord))
+        return true;
 
-    // if we get here, all OK
-    return true;
+    // attempt convert BAX to BAM
+    return WriteRecord(smrtRecord, 0, smrtRecord.length, ReadGroupId(), context, records);
 }
 
-bool PolymeraseReadConverter::ConvertFile(HDFBasReader* reader,
-                                          PacBio::BAM::BamWriter* writer,
-                                          PacBio::BAM::BamWriter* scrapsWriter)
-{ return false; }
-
 std::string PolymeraseReadConverter::HeaderReadType(void) const
 { return "POLYMERASE"; }
 
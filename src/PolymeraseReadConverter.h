@@ -12,11 +12,11 @@ public:
     ~PolymeraseReadConverter(void);
 
 protected:
-    bool ConvertFile(HDFBasReader* reader,
-                     PacBio::BAM::BamWriter* writer);
-    bool ConvertFile(HDFBasReader* reader,
-                     PacBio::BAM::BamWriter* writer,
-                     PacBio::BAM::BamWriter* scrapsWriter);
+    bool EmitsRecords(const ZmwSummary& zmw);
+    bool ConvertZmw(const SMRTSequence& smrtRecord,
+                    ConversionContext* context,
+                    RecordBuffer* records,
+                    RecordBuffer* scraps);
     std::string HeaderReadType(void) const;
     std::string ScrapsReadType(void) const;
     std::string OutputFileSuffix(void) const;
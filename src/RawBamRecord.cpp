@@ -0,0 +1,326 @@
+#include "RawBamRecord.h"
+
+#include <cassert>
+
+#include <htslib/hts.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define RAWBAMRECORD_HAVE_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace internal {
+
+// fixed-length section of a BAM record, after block_size
+static const size_t CoreLength = 32;
+
+// bin of an unmapped record: hts_reg2bin(-1, 0, 14, 5)
+static const uint16_t UnmappedBin = 4680;
+static const uint16_t UnmappedFlag = 4;
+
+static const uint8_t MaxQv = 93;
+
+static inline
+void Store(uint8_t* dst, const void* src, const size_t numBytes)
+{ memcpy(dst, src, numBytes); }
+
+static inline
+void PackBasesScalar(const char* sequence, const size_t length, uint8_t* packed)
+{
+    size_t i = 0;
+    for (; i + 1 < length; i += 2) {
+        *packed++ = (seq_nt16_table[static_cast<uint8_t>(sequence[i])] << 4) |
+                     seq_nt16_table[static_cast<uint8_t>(sequence[i+1])];
+    }
+    if (i < length)
+        *packed = seq_nt16_table[static_cast<uint8_t>(sequence[i])] << 4;
+}
+
+static inline
+void ClampQvsScalar(const uint8_t* qvs, const size_t length, const uint8_t offset, uint8_t* dst)
+{
+    for (size_t i = 0; i < length; ++i)
+        dst[i] = std::min(qvs[i], MaxQv) + offset;
+}
+
+#ifdef RAWBAMRECORD_HAVE_SIMD
+
+// checked once, at startup (cpu_init is needed before main)
+static const bool HasSsse3 = (__builtin_cpu_init(), __builtin_cpu_supports("ssse3"));
+static const bool HasAvx2  = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+
+// see RawBamRecord::LimitSimd()
+static RawBamRecord::SimdLevel MaxSimdLevel = RawBamRecord::Avx2;
+
+// Packs 16 bases at a time. The low nibble of each of A,C,G,T,N (either case)
+// is distinct, so one shuffle maps it to the BAM code & a second one checks
+// that the base really was one of those. Any other byte (IUPAC, '=', ...)
+// sends its block of 16 to the scalar table lookup.
+__attribute__((target("ssse3")))
+static void PackBasesSsse3(const char* sequence, const size_t length, uint8_t* packed)
+{
+    //                                          .   A   .   C   T   .   .   G   .   .   .   .   .   .   N   .
+    const __m128i codes    = _mm_setr_epi8(     0,  1,  0,  2,  8,  0,  0,  4,  0,  0,  0,  0,  0,  0, 15,  0);
+    const __m128i expected = _mm_setr_epi8(    -1,'A', -1,'C','T', -1, -1,'G', -1, -1, -1, -1, -1, -1,'N', -1);
+    const __m128i lowNibble = _mm_set1_epi8(0x0F);
+    const __m128i upperCase = _mm_set1_epi8(static_cast<char>(0xDF));
+    const __m128i lowByte   = _mm_set1_epi16(0x00FF);
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i bases = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sequence + i));
+        const __m128i nibbles = _mm_and_si128(bases, lowNibble);
+        const __m128i valid = _mm_cmpeq_epi8(_mm_and_si128(bases, upperCase),
+                                             _mm_shuffle_epi8(expected, nibbles));
+        if (_mm_movemask_epi8(valid) != 0xFFFF) {
+            PackBasesScalar(sequence + i, 16, packed + i/2);
+            continue;
+        }
+
+        // (first << 4) | second, for each pair of bases
+        const __m128i pairCodes = _mm_shuffle_epi8(codes, nibbles);
+        const __m128i pairs = _mm_or_si128(_mm_slli_epi16(pairCodes, 4),
+                                           _mm_srli_epi16(pairCodes, 8));
+        const __m128i result = _mm_packus_epi16(_mm_and_si128(pairs, lowByte), _mm_setzero_si128());
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(packed + i/2), result);
+    }
+    PackBasesScalar(sequence + i, length - i, packed + i/2);
+}
+
+__attribute__((target("avx2")))
+static void ClampQvsAvx2(const uint8_t* qvs, const size_t length, const uint8_t offset, uint8_t* dst)
+{
+    const __m256i maxQv = _mm256_set1_epi8(MaxQv);
+    const __m256i add   = _mm256_set1_epi8(offset);
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qvs + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_add_epi8(_mm256_min_epu8(q, maxQv), add));
+    }
+    ClampQvsScalar(qvs + i, length - i, offset, dst + i);
+}
+
+// SSE2 is part of x86-64, so needs no check
+static void ClampQvsSse2(const uint8_t* qvs, const size_t length, const uint8_t offset, uint8_t* dst)
+{
+    const __m128i maxQv = _mm_set1_epi8(MaxQv);
+    const __m128i add   = _mm_set1_epi8(offset);
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(qvs + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         _mm_add_epi8(_mm_min_epu8(q, maxQv), add));
+    }
+    ClampQvsScalar(qvs + i, length - i, offset, dst + i);
+}
+
+#endif // RAWBAMRECORD_HAVE_SIMD
+
+// 4-bit packed bases
+static inline
+void PackBases(const char* sequence, const size_t length, uint8_t* packed)
+{
+#ifdef RAWBAMRECORD_HAVE_SIMD
+    if (HasSsse3 && MaxSimdLevel >= RawBamRecord::Sse) {
+        PackBasesSsse3(sequence, length, packed);
+        return;
+    }
+#endif
+    PackBasesScalar(sequence, length, packed);
+}
+
+// min(qv, 93) + offset
+static inline
+void ClampQvs(const uint8_t* qvs, const size_t length, const uint8_t offset, uint8_t* dst)
+{
+#ifdef RAWBAMRECORD_HAVE_SIMD
+    if (HasAvx2 && MaxSimdLevel >= RawBamRecord::Avx2)
+        ClampQvsAvx2(qvs, length, offset, dst);
+    else if (MaxSimdLevel >= RawBamRecord::Sse)
+        ClampQvsSse2(qvs, length, offset, dst);
+    else
+        ClampQvsScalar(qvs, length, offset, dst);
+#else
+    ClampQvsScalar(qvs, length, offset, dst);
+#endif
+}
+
+} // namespace internal
+
+RawBamRecord::RawBamRecord(void)
+    : data_(1024)
+    , size_(0)
+    , sequenceLength_(0)
+{
+    memset(&pbi, 0, sizeof(pbi));
+}
+
+void RawBamRecord::LimitSimd(const SimdLevel level)
+{
+#ifdef RAWBAMRECORD_HAVE_SIMD
+    internal::MaxSimdLevel = level;
+#else
+    (void)level;
+#endif
+}
+
+void RawBamRecord::Start(const char* name, const size_t nameLength)
+{
+    assert(nameLength < 255);
+
+    const int32_t unset = -1;
+    const int32_t zero = 0;
+    const uint8_t readNameLength = static_cast<uint8_t>(nameLength + 1);
+    const uint8_t mapQuality = 255;
+
+    size_ = 0;
+    sequenceLength_ = 0;
+    uint8_t* core = Grow(4 + internal::CoreLength);
+    internal::Store(core +  4, &unset, 4);                     // refID
+    internal::Store(core +  8, &unset, 4);                     // pos
+    internal::Store(core + 12, &readNameLength, 1);            // l_read_name
+    internal::Store(core + 13, &mapQuality, 1);                // mapq
+    internal::Store(core + 14, &internal::UnmappedBin, 2);     // bin
+    internal::Store(core + 16, &zero, 2);                      // n_cigar_op
+    internal::Store(core + 18, &internal::UnmappedFlag, 2);    // flag
+    internal::Store(core + 20, &zero, 4);                      // l_seq
+    internal::Store(core + 24, &unset, 4);                     // next_refID
+    internal::Store(core + 28, &unset, 4);                     // next_pos
+    internal::Store(core + 32, &zero, 4);                      // tlen
+
+    uint8_t* readName = Grow(nameLength + 1);
+    memcpy(readName, name, nameLength);
+    readName[nameLength] = '\0';
+
+    UpdateBlockSize();
+}
+
+void RawBamRecord::SetSequenceAndQualities(const char* sequence,
+                                           const size_t length,
+                                           const uint8_t* qualities)
+{
+    assert(size_ > internal::CoreLength);
+
+    sequenceLength_ = length;
+    const int32_t sequenceLength = static_cast<int32_t>(length);
+    internal::Store(data_.data() + 20, &sequenceLength, 4);   // l_seq
+
+    internal::PackBases(sequence, length, Grow((length + 1) / 2));
+
+    // qualities
+    uint8_t* qual = Grow(length);
+    if (qualities == nullptr)
+        memset(qual, 0xFF, length);
+    else
+        internal::ClampQvs(qualities, length, 0, qual);
+
+    UpdateBlockSize();
+}
+
+void RawBamRecord::AddTagHeader(const char* tag, const char type)
+{
+    uint8_t* header = Grow(3);
+    header[0] = tag[0];
+    header[1] = tag[1];
+    header[2] = type;
+}
+
+void RawBamRecord::AddArrayTagHeader(const char* tag,
+                                     const char subtype,
+                                     const size_t length)
+{
+    AddTagHeader(tag, 'B');
+    const int32_t count = static_cast<int32_t>(length);
+    uint8_t* header = Grow(5);
+    header[0] = subtype;
+    internal::Store(header + 1, &count, 4);
+}
+
+void RawBamRecord::AddCharTag(const char* tag, const char value)
+{
+    AddTagHeader(tag, 'A');
+    *Grow(1) = value;
+    UpdateBlockSize();
+}
+
+void RawBamRecord::AddInt32Tag(const char* tag, const int32_t value)
+{
+    AddTagHeader(tag, 'i');
+    internal::Store(Grow(4), &value, 4);
+    UpdateBlockSize();
+}
+
+void RawBamRecord::AddUInt8Tag(const char* tag, const uint8_t value)
+{
+    AddTagHeader(tag, 'C');
+    *Grow(1) = value;
+    UpdateBlockSize();
+}
+
+void RawBamRecord::AddFloatTag(const char* tag, const float value)
+{
+    AddTagHeader(tag, 'f');
+    internal::Store(Grow(4), &value, 4);
+    UpdateBlockSize();
+}
+
+void RawBamRecord::AddStringTag(const char* tag,
+                                const char* value,
+                                const size_t length)
+{
+    AddTagHeader(tag, 'Z');
+    uint8_t* dst = Grow(length + 1);
+    memcpy(dst, value, length);
+    dst[length] = '\0';
+    UpdateBlockSize();
+}
+
+void RawBamRecord::AddQvTag(const char* tag,
+                            const uint8_t* qvs,
+                            const size_t length)
+{
+    AddTagHeader(tag, 'Z');
+    uint8_t* dst = Grow(length + 1);
+    internal::ClampQvs(qvs, length, 33, dst);
+    dst[length] = '\0';
+    UpdateBlockSize();
+}
+
+void RawBamRecord::AddFloatArrayTag(const char* tag,
+                                    const float* values,
+                                    const size_t length)
+{
+    AddArrayTagHeader(tag, 'f', length);
+    internal::Store(Grow(length * sizeof(float)), values, length * sizeof(float));
+    UpdateBlockSize();
+}
+
+void RawBamRecord::AddUInt8ArrayTag(const char* tag,
+                                    const uint8_t* values,
+                                    const size_t length)
+{
+    AddArrayTagHeader(tag, 'C', length);
+    internal::Store(Grow(length), values, length);
+    UpdateBlockSize();
+}
+
+uint8_t* RawBamRecord::AddUInt8ArrayTag(const char* tag,
+                                        const size_t length)
+{
+    AddArrayTagHeader(tag, 'C', length);
+    uint8_t* values = Grow(length);
+    UpdateBlockSize();
+    return values;
+}
+
+void RawBamRecord::AddUInt16ArrayTag(const char* tag,
+                                     const uint16_t* values,
+                                     const size_t length)
+{
+    AddArrayTagHeader(tag, 'S', length);
+    internal::Store(Grow(length * sizeof(uint16_t)), values, length * sizeof(uint16_t));
+    UpdateBlockSize();
+}
@@ -0,0 +1,123 @@
+#ifndef RAWBAMRECORD_H
+#define RAWBAMRECORD_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//
+// RawBamRecord is an unmapped BAM record, encoded directly into the bytes
+// stored in a BAM file (starting with block_size). The buffer is re-used
+// across records, so steady-state encoding does not allocate.
+//
+// Fields must be added in BAM order:
+//
+//     Start(name) -> SetSequenceAndQualities(...) -> Add*Tag(...) ...
+//
+// Tags are written in the order they are added.
+//
+class RawBamRecord
+{
+public:
+    // basic PBI fields for this record
+    struct PbiFields
+    {
+        int32_t rgId;
+        int32_t qStart;
+        int32_t qEnd;
+        int32_t holeNumber;
+        float readQual;
+        uint8_t ctxtFlag;
+    };
+
+    // instruction sets used to encode records (see LimitSimd())
+    enum SimdLevel
+    {
+        NoSimd,
+        Sse,        // SSE2, and SSSE3 if supported
+        Avx2
+    };
+
+public:
+    RawBamRecord(void);
+
+public:
+    // Encodes with at most 'level', or what the CPU supports if lower (the
+    // default is all it supports), for checking the vector code against the
+    // scalar code. Applies to all records: set it before encoding any.
+    static void LimitSimd(const SimdLevel level);
+
+public:
+    void Start(const char* name, const size_t nameLength);
+    void Start(const std::string& name);
+
+    // 'qualities' may be null, in which case qualities are stored as missing
+    // (0xFF). Otherwise values are clamped to 93, as in FASTQ.
+    void SetSequenceAndQualities(const char* sequence,
+                                 const size_t length,
+                                 const uint8_t* qualities);
+
+    void AddCharTag(const char* tag, const char value);                 // A
+    void AddInt32Tag(const char* tag, const int32_t value);             // i
+    void AddUInt8Tag(const char* tag, const uint8_t value);             // C
+    void AddFloatTag(const char* tag, const float value);               // f
+    void AddStringTag(const char* tag, const char* value, const size_t length);  // Z
+    void AddStringTag(const char* tag, const std::string& value);       // Z
+
+    // QVs as FASTQ-encoded string: min(qv, 93) + 33
+    void AddQvTag(const char* tag, const uint8_t* qvs, const size_t length);     // Z
+
+    void AddFloatArrayTag(const char* tag, const float* values, const size_t length);      // B,f
+    void AddUInt8ArrayTag(const char* tag, const uint8_t* values, const size_t length);    // B,C
+    void AddUInt16ArrayTag(const char* tag, const uint16_t* values, const size_t length);  // B,S
+
+    // Adds a B,C tag of 'length' values, returning them for the caller to
+    // fill in. Valid until the next field is added.
+    uint8_t* AddUInt8ArrayTag(const char* tag, const size_t length);                        // B,C
+
+public:
+    const uint8_t* Data(void) const { return data_.data(); }
+    size_t Size(void) const { return size_; }
+    size_t SequenceLength(void) const { return sequenceLength_; }
+
+public:
+    PbiFields pbi;
+
+private:
+    uint8_t* Grow(const size_t numBytes);
+    void AddTagHeader(const char* tag, const char type);
+    void AddArrayTagHeader(const char* tag, const char subtype, const size_t length);
+    void UpdateBlockSize(void);
+
+private:
+    std::vector<uint8_t> data_;
+    size_t size_;
+    size_t sequenceLength_;
+};
+
+inline void RawBamRecord::Start(const std::string& name)
+{ Start(name.data(), name.size()); }
+
+inline void RawBamRecord::AddStringTag(const char* tag, const std::string& value)
+{ AddStringTag(tag, value.data(), value.size()); }
+
+inline uint8_t* RawBamRecord::Grow(const size_t numBytes)
+{
+    if (size_ + numBytes > data_.size())
+        data_.resize(std::max(size_ + numBytes, 2 * data_.size()));
+    uint8_t* result = data_.data() + size_;
+    size_ += numBytes;
+    return result;
+}
+
+inline void RawBamRecord::UpdateBlockSize(void)
+{
+    // NOTE - BAM is little-endian, as is every platform we build on
+    const int32_t blockSize = static_cast<int32_t>(size_ - 4);
+    memcpy(data_.data(), &blockSize, 4);
+}
+
+#endif // RAWBAMRECORD_H
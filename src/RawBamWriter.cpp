@@ -0,0 +1,285 @@
+#include "RawBamWriter.h"
+#include "BgzfConcat.h"
+#include "PbiWriter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+#include <pbbam/PbiFile.h>
+
+RawBamWriter::RawBamWriter(const std::string& filename,
+                           const PacBio::BAM::BamHeader& header,
+                           hts_tpool* threadPool,
+                           const int compressionLevel,
+                           const bool adaptiveCompression)
+    : filename_(filename)
+    , isOpen_(false)
+    , failed_(false)
+    , uncompressedOffset_(0)
+    , compressedOffset_(0)
+    , threadPool_(threadPool)
+    , queue_(nullptr)
+    , numQueued_(0)
+    , current_(new Block)
+    , level_(compressionLevel)
+    , windowBytes_(0)
+    , bytesAtLevel_(10, 0)
+    , compressSeconds_(0.0)
+    , writeSeconds_(0.0)
+{
+    // adaptive compression starts from the given (or htslib's default) level
+    if (adaptiveCompression) {
+        tuner_.reset(new CompressionTuner(compressionLevel >= 0 ? compressionLevel : 6));
+        level_ = tuner_->Level();
+    }
+
+    out_.open(filename_, std::ios::binary | std::ios::trunc);
+    if (!out_)
+        throw std::runtime_error("could not open "+filename_+" for writing");
+    if (threadPool_) {
+        queue_ = hts_tpool_process_init(threadPool_, static_cast<int>(MaxQueuedBlocks), 0);
+        if (queue_ == nullptr)
+            throw std::runtime_error("could not initialize BGZF output for "+filename_);
+    }
+    isOpen_ = true;
+    current_->uncompressedOffset = 0;
+    current_->uncompressed.reserve(BGZF_BLOCK_SIZE);
+
+    // header: magic, text & (no) references, flushed so records start on a
+    // block boundary
+    try {
+        const std::string text = header.ToSam();
+        const int32_t textLength = static_cast<int32_t>(text.size());
+        const int32_t numReferences = 0;
+        Append("BAM\1", 4);
+        Append(&textLength, 4);
+        Append(text.data(), text.size());
+        Append(&numReferences, 4);
+        QueueBlock();
+    } catch (std::exception&) {
+        isOpen_ = false;
+        Release();
+        throw std::runtime_error("could not write header to "+filename_);
+    }
+    windowStart_ = std::chrono::steady_clock::now();
+}
+
+RawBamWriter::~RawBamWriter(void)
+{
+    // without Close(), the file is abandoned: no last block, EOF marker or PBI
+    Release();
+    out_.close();
+}
+
+void RawBamWriter::Write(const RawBamRecord& record)
+{
+    if (failed_)
+        throw std::runtime_error("could not write to "+filename_+" after an earlier error");
+
+    // as htslib's bam_write1() (bgzf_flush_try()): a record that fits in a
+    // block is never split across blocks
+    if (current_->uncompressed.size() + record.Size() > BGZF_BLOCK_SIZE)
+        QueueBlock();
+
+    index_.rgId_.push_back(record.pbi.rgId);
+    index_.qStart_.push_back(record.pbi.qStart);
+    index_.qEnd_.push_back(record.pbi.qEnd);
+    index_.holeNumber_.push_back(record.pbi.holeNumber);
+    index_.readQual_.push_back(record.pbi.readQual);
+    index_.ctxtFlag_.push_back(record.pbi.ctxtFlag);
+    index_.fileOffset_.push_back(uncompressedOffset_);
+
+    Append(record.Data(), record.Size());
+}
+
+void RawBamWriter::Append(const void* data, size_t length)
+{
+    try {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        while (length > 0) {
+            std::vector<uint8_t>& block = current_->uncompressed;
+            const size_t n = std::min(length, static_cast<size_t>(BGZF_BLOCK_SIZE) - block.size());
+            block.insert(block.end(), bytes, bytes + n);
+            bytes += n;
+            length -= n;
+            uncompressedOffset_ += n;
+            if (block.size() == BGZF_BLOCK_SIZE)
+                QueueBlock();
+        }
+    } catch (...) {
+        failed_ = true;
+        throw;
+    }
+}
+
+void RawBamWriter::QueueBlock(void)
+{
+    if (current_->uncompressed.empty())
+        return;
+
+    try {
+        // start the next block (re-using a written one) before anything can
+        // throw, so current_ is always valid
+        std::unique_ptr<Block> block;
+        if (freeBlocks_.empty())
+            block.reset(new Block);
+        else {
+            block = std::move(freeBlocks_.back());
+            freeBlocks_.pop_back();
+        }
+        block->uncompressedOffset = uncompressedOffset_;
+        block->uncompressed.clear();
+        block->uncompressed.reserve(BGZF_BLOCK_SIZE);
+        std::swap(block, current_);
+
+        block->level = level_;
+        if (queue_) {
+            // make room, then hand the block to the pool & write out any done
+            if (numQueued_ == MaxQueuedBlocks)
+                WriteNextBlock(true);
+            if (hts_tpool_dispatch(threadPool_, queue_, &RawBamWriter::CompressBlock, block.get()) != 0)
+                throw std::runtime_error("could not queue BGZF block for "+filename_);
+            block.release();
+            ++numQueued_;
+            while (WriteNextBlock(false)) { }
+        } else {
+            CompressBlock(block.get());
+            WriteBlock(std::move(block));
+        }
+    } catch (...) {
+        failed_ = true;
+        throw;
+    }
+}
+
+void* RawBamWriter::CompressBlock(void* arg)
+{
+    Block* block = static_cast<Block*>(arg);
+    const auto start = std::chrono::steady_clock::now();
+    block->compressed.resize(BGZF_MAX_BLOCK_SIZE);
+    block->compressedLength = block->compressed.size();
+    block->result = bgzf_compress(block->compressed.data(), &block->compressedLength,
+                                  block->uncompressed.data(), block->uncompressed.size(),
+                                  block->level);
+    block->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return block;
+}
+
+bool RawBamWriter::WriteNextBlock(const bool wait)
+{
+    if (numQueued_ == 0)
+        return false;
+    hts_tpool_result* result = (wait ? hts_tpool_next_result_wait(queue_)
+                                     : hts_tpool_next_result(queue_));
+    if (result == nullptr) {
+        if (wait)
+            throw std::runtime_error("could not compress BGZF block for "+filename_);
+        return false;
+    }
+    std::unique_ptr<Block> block(static_cast<Block*>(hts_tpool_result_data(result)));
+    hts_tpool_delete_result(result, 0);
+    --numQueued_;
+    WriteBlock(std::move(block));
+    return true;
+}
+
+void RawBamWriter::WriteBlock(std::unique_ptr<Block> block)
+{
+    if (block->result != 0)
+        throw std::runtime_error("could not compress BGZF block for "+filename_);
+
+    const auto start = std::chrono::steady_clock::now();
+    out_.write(reinterpret_cast<const char*>(block->compressed.data()), block->compressedLength);
+    if (!out_)
+        throw std::runtime_error("could not write to "+filename_);
+    const auto now = std::chrono::steady_clock::now();
+    writeSeconds_ += std::chrono::duration<double>(now - start).count();
+    compressSeconds_ += block->seconds;
+
+    blockOffsets_.push_back(BlockOffset{ compressedOffset_, block->uncompressedOffset });
+    compressedOffset_ += block->compressedLength;
+    bytesAtLevel_.at(block->level >= 0 ? block->level : 6) += block->uncompressed.size();
+
+    // a window ends as its last block is written, so its rate covers
+    // everything from conversion to disk; the new level applies to blocks
+    // queued from now on
+    if (tuner_) {
+        windowBytes_ += block->uncompressed.size();
+        if (windowBytes_ >= CompressionTuner::WindowBytes) {
+            const double seconds = std::chrono::duration<double>(now - windowStart_).count();
+            level_ = tuner_->EndWindow(windowBytes_, seconds);
+            windowBytes_ = 0;
+            windowStart_ = now;
+        }
+    }
+
+    freeBlocks_.push_back(std::move(block));
+}
+
+void RawBamWriter::Release(void)
+{
+    if (queue_ == nullptr)
+        return;
+    while (numQueued_ > 0) {
+        hts_tpool_result* result = hts_tpool_next_result_wait(queue_);
+        if (result == nullptr)
+            break;
+        delete static_cast<Block*>(hts_tpool_result_data(result));
+        hts_tpool_delete_result(result, 0);
+        --numQueued_;
+    }
+    hts_tpool_process_destroy(queue_);
+    queue_ = nullptr;
+}
+
+void RawBamWriter::Close(void)
+{
+    if (!isOpen_)
+        return;
+    isOpen_ = false;
+
+    // after a failed write, leave the file unfinished & unindexed
+    if (failed_) {
+        Release();
+        out_.close();
+        throw std::runtime_error("could not finish "+filename_+" after an earlier error");
+    }
+
+    // last block, then the EOF marker
+    QueueBlock();
+    try {
+        while (WriteNextBlock(true)) { }
+    } catch (...) {
+        failed_ = true;
+        throw;
+    }
+    Release();
+    out_.write(reinterpret_cast<const char*>(BgzfConcat::EofBlock), sizeof(BgzfConcat::EofBlock));
+    out_.close();
+    if (!out_)
+        throw std::runtime_error("could not write to "+filename_);
+
+    ResolveFileOffsets();
+    PbiWriter::Write(index_, PacBio::BAM::PbiFile::CurrentVersion, filename_ + ".pbi");
+}
+
+void RawBamWriter::ResolveFileOffsets(void)
+{
+    if (index_.fileOffset_.empty())
+        return;
+    if (blockOffsets_.empty())
+        throw std::runtime_error("could not resolve record offsets in "+filename_);
+
+    // records & blocks are both in file order, so walk them together
+    size_t block = 0;
+    for (int64_t& offset : index_.fileOffset_) {
+        const uint64_t uncompressed = static_cast<uint64_t>(offset);
+        while (block + 1 < blockOffsets_.size() && blockOffsets_[block + 1].uncompressed <= uncompressed)
+            ++block;
+        const uint64_t withinBlock = uncompressed - blockOffsets_[block].uncompressed;
+        if (withinBlock > 0xFFFF)
+            throw std::runtime_error("could not resolve record offsets in "+filename_);
+        offset = static_cast<int64_t>((blockOffsets_[block].compressed << 16) | withinBlock);
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef RAWBAMWRITER_H
+#define RAWBAMWRITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <htslib/bgzf.h>
+#include <htslib/thread_pool.h>
+
+#include <pbbam/BamHeader.h>
+#include <pbbam/PbiRawData.h>
+
+#include "CompressionTuner.h"
+#include "RawBamRecord.h"
+
+//
+// RawBamWriter writes pre-encoded (RawBamRecord) records to a BAM file and
+// builds its PBI index from the records' PBI fields as they are written.
+//
+// BGZF blocks are cut & compressed here (with htslib's bgzf_compress(), as
+// its own writer does), and cut where htslib's bam_write1() cuts them: a
+// record that fits in a block never straddles two. At the same level, the
+// file is byte-for-byte what htslib would write.
+// Blocks are compressed at 'compressionLevel' (0-9, -1 for htslib's default),
+// on 'threadPool' if given (which writers may share), otherwise on the
+// writing thread. With a pool, up to MaxQueuedBlocks blocks are in flight,
+// and written out in order as they are done.
+//
+// Each block carries its own level, so with 'adaptiveCompression' the level
+// can change at any block: 'compressionLevel' is only the starting level,
+// and a CompressionTuner adjusts it from the rate at which blocks are
+// written. Nothing waits for the queue to drain.
+//
+// Records' virtual offsets are resolved on Close(), from the offsets of the
+// blocks written, so the BAM file is never read back.
+//
+// Throws std::runtime_error on failure. Once a write has failed, the file is
+// left as is: Close() throws, and writes neither the EOF block nor the PBI.
+//
+class RawBamWriter
+{
+public:
+    static const size_t MaxQueuedBlocks = 64;
+
+public:
+    RawBamWriter(const std::string& filename,
+                 const PacBio::BAM::BamHeader& header,
+                 hts_tpool* threadPool = nullptr,
+                 const int compressionLevel = -1,
+                 const bool adaptiveCompression = false);
+    ~RawBamWriter(void);
+
+    RawBamWriter(const RawBamWriter&) = delete;
+    RawBamWriter& operator=(const RawBamWriter&) = delete;
+
+public:
+    void Write(const RawBamRecord& record);
+
+    // Finishes the BAM file and writes its PBI index (<filename>.pbi).
+    // Must be called explicitly: a writer destroyed without it leaves its
+    // file unfinished (no EOF marker) and unindexed. Throws if an earlier
+    // write failed.
+    void Close(void);
+
+    // Uncompressed bytes written at each deflate level (0-9). Complete
+    // after Close().
+    const std::vector<uint64_t>& BytesAtLevel(void) const { return bytesAtLevel_; }
+
+    // Time spent compressing blocks (over all threads), and writing them.
+    double CompressSeconds(void) const { return compressSeconds_; }
+    double WriteSeconds(void) const { return writeSeconds_; }
+
+private:
+    // one BGZF block, compressed on the pool (or inline)
+    struct Block
+    {
+        uint64_t uncompressedOffset;        // of its first byte
+        std::vector<uint8_t> uncompressed;
+        std::vector<uint8_t> compressed;
+        size_t compressedLength;
+        int level;
+        int result;                         // of bgzf_compress()
+        double seconds;                     // spent compressing
+    };
+
+    // start of a block, in the compressed & uncompressed streams
+    struct BlockOffset
+    {
+        uint64_t compressed;
+        uint64_t uncompressed;
+    };
+
+private:
+    void Append(const void* data, size_t length);
+
+    // Compresses the current block (if not empty), and starts the next.
+    // current_ is valid even if this throws.
+    void QueueBlock(void);
+
+    // Writes the oldest queued block, once compressed. Returns false if
+    // none is done yet and 'wait' is not set.
+    bool WriteNextBlock(const bool wait);
+    void WriteBlock(std::unique_ptr<Block> block);
+
+    static void* CompressBlock(void* block);
+
+    // Waits for & drops any queued blocks, and the queue.
+    void Release(void);
+
+    void ResolveFileOffsets(void);
+
+private:
+    std::string filename_;
+    std::ofstream out_;
+    bool isOpen_;
+    bool failed_;                                           // a write threw
+    int64_t uncompressedOffset_;
+    uint64_t compressedOffset_;
+
+    // blocks
+    hts_tpool* threadPool_;
+    hts_tpool_process* queue_;                              // null without a pool
+    size_t numQueued_;
+    std::unique_ptr<Block> current_;                        // being filled
+    std::vector<std::unique_ptr<Block> > freeBlocks_;
+    std::vector<BlockOffset> blockOffsets_;                 // of blocks written
+    int level_;                                             // of the next block
+
+    // adaptive compression, if used
+    std::unique_ptr<CompressionTuner> tuner_;
+    uint64_t windowBytes_;                                  // uncompressed, written in the window
+    std::chrono::steady_clock::time_point windowStart_;
+
+    // stats
+    std::vector<uint64_t> bytesAtLevel_;
+    double compressSeconds_;
+    double writeSeconds_;
+
+    // fileOffset_ holds uncompressed offsets until Close()
+    PacBio::BAM::PbiRawBasicData index_;
+};
+
+#endif // RAWBAMWRITER_H
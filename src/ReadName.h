@@ -0,0 +1,77 @@
+#ifndef READNAME_H
+#define READNAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+//
+// ReadName builds a record name ("<movie>/<zmw>/<start>_<end>", etc.) in a
+// fixed buffer, so formatting a name does not allocate. The "<movie>/" prefix
+// is rendered once per run and copied in.
+//
+// Prefixes longer than MaxPrefixLength are rejected up front (see
+// ConverterBase::Run()). Appending past MaxLength throws std::length_error.
+//
+class ReadName
+{
+public:
+    // BAM read names are at most 254 characters
+    static const size_t MaxLength = 254;
+
+    // room left for the longest name after the prefix: "<zmw>/<start>_<end>",
+    // of 32-bit values
+    static const size_t MaxPrefixLength = MaxLength - (10 + 1 + 10 + 1 + 10);
+
+public:
+    explicit ReadName(const std::string& prefix);
+
+public:
+    ReadName& Append(const char c);
+    ReadName& Append(const char* s, const size_t length);
+    ReadName& Append(uint32_t value);
+
+    const char* Data(void) const { return data_; }
+    size_t Size(void) const { return size_; }
+
+private:
+    char data_[MaxLength + 1];
+    size_t size_;
+};
+
+inline ReadName::ReadName(const std::string& prefix)
+    : size_(0)
+{ Append(prefix.data(), prefix.size()); }
+
+inline ReadName& ReadName::Append(const char c)
+{
+    if (size_ >= MaxLength)
+        throw std::length_error("read name longer than 254 characters");
+    data_[size_++] = c;
+    return *this;
+}
+
+inline ReadName& ReadName::Append(const char* s, const size_t length)
+{
+    if (size_ + length > MaxLength)
+        throw std::length_error("read name longer than 254 characters");
+    memcpy(data_ + size_, s, length);
+    size_ += length;
+    return *this;
+}
+
+inline ReadName& ReadName::Append(uint32_t value)
+{
+    // digits are produced last-to-first
+    char digits[10];
+    char* first = digits + sizeof(digits);
+    do {
+        *--first = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    return Append(first, digits + sizeof(digits) - first);
+}
+
+#endif // READNAME_H
@@ -0,0 +1,286 @@
+#include "ReadaheadFileDriver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if H5_VERSION_GE(1,13,2)
+#include <H5FDdevelop.h>
+#endif
+
+namespace internal {
+
+// One window of file contents.
+struct ReadaheadWindow
+{
+    unsigned char* data;
+    size_t capacity;
+    haddr_t start;
+    size_t size;
+};
+
+// Driver's file struct. HDF5 only sees the leading public part.
+struct ReadaheadFile
+{
+    H5FD_t pub;
+    int fd;
+    dev_t device;
+    ino_t inode;
+    haddr_t eoa;
+    haddr_t eof;
+    ReadaheadWindow windows[2];     // raw data, metadata
+};
+
+static std::atomic<uint64_t> bytesRequested(0);
+static std::atomic<uint64_t> bytesRead(0);
+static std::atomic<uint64_t> numReads(0);
+
+static const haddr_t MaxAddress = (static_cast<haddr_t>(1) << (8*sizeof(off_t) - 1)) - 1;
+
+static inline
+ReadaheadFile* FileFrom(H5FD_t* file)
+{ return reinterpret_cast<ReadaheadFile*>(file); }
+
+static inline
+const ReadaheadFile* FileFrom(const H5FD_t* file)
+{ return reinterpret_cast<const ReadaheadFile*>(file); }
+
+// Reads 'size' bytes at 'offset', retrying interrupted & short reads.
+static bool ReadFully(const int fd, unsigned char* data, size_t size, off_t offset)
+{
+    while (size > 0) {
+        const ssize_t n = pread(fd, data, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+        offset += n;
+    }
+    return true;
+}
+
+static bool LoadWindow(ReadaheadFile* file,
+                       ReadaheadWindow* window,
+                       const haddr_t addr)
+{
+    // window starts aligned at or before 'addr', and is cut short at EOF
+    const haddr_t start = addr - (addr % ReadaheadFileDriver::WindowAlignment);
+    const size_t size = static_cast<size_t>(std::min<haddr_t>(window->capacity, file->eof - start));
+
+    window->size = 0;
+    if (!ReadFully(file->fd, window->data, size, static_cast<off_t>(start)))
+        return false;
+    window->start = start;
+    window->size = size;
+    bytesRead += size;
+    ++numReads;
+
+    // get the kernel started on the next window
+    posix_fadvise(file->fd, static_cast<off_t>(start + size), window->capacity, POSIX_FADV_WILLNEED);
+    return true;
+}
+
+//
+// driver callbacks
+//
+
+static H5FD_t* Open(const char* name, unsigned flags, hid_t /*fapl*/, haddr_t maxaddr)
+{
+    if ((flags & (H5F_ACC_RDWR | H5F_ACC_CREAT | H5F_ACC_TRUNC | H5F_ACC_EXCL)) != 0)
+        return nullptr;     // read-only
+    if (name == nullptr || *name == '\0' || maxaddr == 0 || maxaddr == HADDR_UNDEF || maxaddr > MaxAddress)
+        return nullptr;
+
+    const int fd = open(name, O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    ReadaheadFile* file = new ReadaheadFile;
+    memset(&file->pub, 0, sizeof(file->pub));
+    file->fd = fd;
+    file->device = status.st_dev;
+    file->inode = status.st_ino;
+    file->eoa = 0;
+    file->eof = static_cast<haddr_t>(status.st_size);
+
+    const size_t capacities[2] = { ReadaheadFileDriver::RawDataWindowSize,
+                                   ReadaheadFileDriver::MetadataWindowSize };
+    for (size_t i = 0; i < 2; ++i) {
+        ReadaheadWindow& window = file->windows[i];
+        window.capacity = capacities[i];
+        window.data = new unsigned char[window.capacity];
+        window.start = 0;
+        window.size = 0;
+    }
+    return &file->pub;
+}
+
+static herr_t Close(H5FD_t* _file)
+{
+    ReadaheadFile* file = FileFrom(_file);
+    const int result = close(file->fd);
+    for (ReadaheadWindow& window : file->windows)
+        delete[] window.data;
+    delete file;
+    return (result == 0 ? 0 : -1);
+}
+
+static int Compare(const H5FD_t* _lhs, const H5FD_t* _rhs)
+{
+    const ReadaheadFile* lhs = FileFrom(_lhs);
+    const ReadaheadFile* rhs = FileFrom(_rhs);
+    if (lhs->device != rhs->device)
+        return (lhs->device < rhs->device ? -1 : 1);
+    if (lhs->inode != rhs->inode)
+        return (lhs->inode < rhs->inode ? -1 : 1);
+    return 0;
+}
+
+static herr_t Query(const H5FD_t* /*file*/, unsigned long* flags)
+{
+    if (flags) {
+        *flags = H5FD_FEAT_AGGREGATE_METADATA |
+                 H5FD_FEAT_ACCUMULATE_METADATA |
+                 H5FD_FEAT_DATA_SIEVE |
+                 H5FD_FEAT_AGGREGATE_SMALLDATA;
+    }
+    return 0;
+}
+
+static haddr_t GetEoa(const H5FD_t* file, H5FD_mem_t /*type*/)
+{ return FileFrom(file)->eoa; }
+
+static herr_t SetEoa(H5FD_t* file, H5FD_mem_t /*type*/, haddr_t addr)
+{
+    FileFrom(file)->eoa = addr;
+    return 0;
+}
+
+static haddr_t GetEof(const H5FD_t* file, H5FD_mem_t /*type*/)
+{ return FileFrom(file)->eof; }
+
+static herr_t GetHandle(H5FD_t* file, hid_t /*fapl*/, void** handle)
+{
+    if (!handle)
+        return -1;
+    *handle = &FileFrom(file)->fd;
+    return 0;
+}
+
+static herr_t Read(H5FD_t* _file, H5FD_mem_t type, hid_t /*dxpl*/,
+                   haddr_t addr, size_t size, void* buffer)
+{
+    ReadaheadFile* file = FileFrom(_file);
+    if (addr == HADDR_UNDEF || addr + size < addr || addr + size > file->eoa)
+        return -1;
+    bytesRequested += size;
+
+    ReadaheadWindow* window = &file->windows[type == H5FD_MEM_DRAW ? 0 : 1];
+    unsigned char* out = static_cast<unsigned char*>(buffer);
+    while (size > 0) {
+
+        // past EOF (but within EOA) reads as zeros
+        if (addr >= file->eof) {
+            memset(out, 0, size);
+            break;
+        }
+
+        size_t n = 0;
+        if (addr >= window->start && addr < window->start + window->size) {
+            n = std::min(size, static_cast<size_t>(window->start + window->size - addr));
+            memcpy(out, window->data + (addr - window->start), n);
+        } else if (size >= window->capacity) {
+            // too big to window, read straight through
+            n = static_cast<size_t>(std::min<haddr_t>(size, file->eof - addr));
+            if (!ReadFully(file->fd, out, n, static_cast<off_t>(addr)))
+                return -1;
+            bytesRead += n;
+            ++numReads;
+        } else {
+            if (!LoadWindow(file, window, addr))
+                return -1;
+            continue;
+        }
+
+        out += n;
+        addr += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static herr_t Write(H5FD_t* /*file*/, H5FD_mem_t /*type*/, hid_t /*dxpl*/,
+                    haddr_t /*addr*/, size_t /*size*/, const void* /*buffer*/)
+{ return -1; }
+
+static herr_t Truncate(H5FD_t* /*file*/, hid_t /*dxpl*/, hbool_t /*closing*/)
+{ return 0; }
+
+static hid_t RegisterDriver(void)
+{
+    // fields are set by name, as the struct layout varies between HDF5 versions
+    static H5FD_class_t driverClass;
+    memset(&driverClass, 0, sizeof(driverClass));
+#if H5_VERSION_GE(1,13,2)
+    driverClass.version = H5FD_CLASS_VERSION;
+    driverClass.value = static_cast<H5FD_class_value_t>(600);
+#endif
+    driverClass.name = "bax2bam_readahead";
+    driverClass.maxaddr = MaxAddress;
+    driverClass.fc_degree = H5F_CLOSE_WEAK;
+    driverClass.open = Open;
+    driverClass.close = Close;
+    driverClass.cmp = Compare;
+    driverClass.query = Query;
+    driverClass.get_eoa = GetEoa;
+    driverClass.set_eoa = SetEoa;
+    driverClass.get_eof = GetEof;
+    driverClass.get_handle = GetHandle;
+    driverClass.read = Read;
+    driverClass.write = Write;
+    driverClass.truncate = Truncate;
+    const H5FD_mem_t freeListMap[H5FD_MEM_NTYPES] = H5FD_FLMAP_DICHOTOMY;
+    memcpy(driverClass.fl_map, freeListMap, sizeof(freeListMap));
+
+    return H5FDregister(&driverClass);
+}
+
+} // namespace internal
+
+H5::FileAccPropList ReadaheadFileDriver::FileAccess(void)
+{
+    static std::once_flag registered;
+    static hid_t driverId = -1;
+    std::call_once(registered, []() { driverId = internal::RegisterDriver(); });
+    if (driverId < 0)
+        throw std::runtime_error("could not register readahead HDF5 file driver");
+
+    H5::FileAccPropList fileAccess;
+    if (H5Pset_driver(fileAccess.getId(), driverId, nullptr) < 0)
+        throw std::runtime_error("could not set readahead HDF5 file driver");
+    return fileAccess;
+}
+
+ReadaheadFileDriver::Stats ReadaheadFileDriver::TotalStats(void)
+{
+    Stats stats;
+    stats.bytesRequested = internal::bytesRequested;
+    stats.bytesRead = internal::bytesRead;
+    stats.numReads = internal::numReads;
+    return stats;
+}
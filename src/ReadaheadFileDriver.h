@@ -0,0 +1,46 @@
+#ifndef READAHEADFILEDRIVER_H
+#define READAHEADFILEDRIVER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <H5Cpp.h>
+
+//
+// ReadaheadFileDriver is a read-only HDF5 virtual file driver for input on
+// network storage.
+//
+// Instead of passing each (often small, scattered) library read on to the
+// file system, as the default sec2 driver does, it reads large aligned
+// windows of the file and serves requests from them. Raw data and metadata
+// have separate windows, as HDF5 interleaves chunk index lookups with chunk
+// reads. The kernel is told access is sequential and asked to prefetch the
+// window following each one read.
+//
+// Files are opened through the FileAccess() property list. Like all HDF5
+// calls, driver callbacks must be serialized by the caller.
+//
+class ReadaheadFileDriver
+{
+public:
+    // Totals over all files read through the driver.
+    struct Stats
+    {
+        uint64_t bytesRequested;    // by the HDF5 library
+        uint64_t bytesRead;         // from the file system
+        uint64_t numReads;          // file system reads
+    };
+
+    static const size_t RawDataWindowSize  = 32 << 20;
+    static const size_t MetadataWindowSize =  4 << 20;
+    static const size_t WindowAlignment    =  1 << 20;
+
+public:
+    // File access property list using the driver. Registers the driver with
+    // HDF5 on first use, throws std::runtime_error if that fails.
+    static H5::FileAccPropList FileAccess(void);
+
+    static Stats TotalStats(void);
+};
+
+#endif // READAHEADFILEDRIVER_H
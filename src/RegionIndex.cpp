@@ -0,0 +1,97 @@
+#include "RegionIndex.h"
+
+#include <algorithm>
+
+namespace internal {
+
+static inline
+bool IntervalLessThan(const ReadInterval& lhs, const ReadInterval& rhs)
+{
+    if (lhs.start == rhs.start)
+        return lhs.end < rhs.end;
+    return lhs.start < rhs.start;
+}
+
+} // namespace internal
+
+RegionIndex::RegionIndex(void)
+    : firstHoleNumber_(0)
+{ }
+
+void RegionIndex::Build(const RegionTable& regionTable,
+                        const std::vector<UInt>& holeNumbers)
+{
+    flags_.clear();
+    hqRegions_.clear();
+    adapterOffsets_.assign(1, 0);
+    adapters_.clear();
+    firstHoleNumber_ = 0;
+    if (holeNumbers.empty())
+        return;
+
+    const auto range = std::minmax_element(holeNumbers.cbegin(), holeNumbers.cend());
+    firstHoleNumber_ = *range.first;
+    const size_t numHoles = *range.second - firstHoleNumber_ + 1;
+    flags_.assign(numHoles, 0);
+    hqRegions_.assign(numHoles, Interval{0, 0});
+    adapterOffsets_.assign(numHoles + 1, 0);
+
+    // walk hole numbers in order, so each ZMW's adapters are appended as one run
+    for (size_t index = 0; index < numHoles; ++index) {
+        adapterOffsets_[index] = static_cast<uint32_t>(adapters_.size());
+
+        const UInt holeNumber = firstHoleNumber_ + index;
+        if (!regionTable.HasHoleNumber(holeNumber))
+            continue;
+
+        const RegionAnnotations zmwRegions = regionTable[holeNumber];
+        flags_[index] = Found;
+        hqRegions_[index] = Interval{ static_cast<int>(zmwRegions.HQStart()),
+                                      static_cast<int>(zmwRegions.HQEnd()) };
+        if (!zmwRegions.HasHQRegion())
+            continue;
+        flags_[index] |= HasHqRegion;
+
+        // Catch and trim overlapping adapter calls
+        // Shared starts indicate multiple alignments for the same adapter
+        // Unique starts indicate multiple overlapping adapters
+        // Therefore we trim adapter ends and remove any 0-length adapters
+        // such that the number of adapter regions == number of adapters
+        std::vector<ReadInterval> adapterIntervals = zmwRegions.AdapterIntervals();
+        std::stable_sort(adapterIntervals.begin(), adapterIntervals.end(), internal::IntervalLessThan);
+        for (size_t i = 1; i < adapterIntervals.size(); i++) {
+            if (adapterIntervals[i-1].end > adapterIntervals[i].start)
+                adapterIntervals[i-1].end = adapterIntervals[i].start;
+        }
+        for (const ReadInterval& interval : adapterIntervals) {
+            if (interval.start != interval.end)
+                adapters_.push_back(Interval{ static_cast<int>(interval.start),
+                                              static_cast<int>(interval.end) });
+        }
+    }
+    adapterOffsets_[numHoles] = static_cast<uint32_t>(adapters_.size());
+}
+
+RegionIndex::ZmwRegions RegionIndex::Find(const UInt holeNumber) const
+{
+    ZmwRegions result{ false, false, Interval{0, 0}, adapters_.data(), adapters_.data() };
+
+    const size_t index = holeNumber - firstHoleNumber_;
+    if (holeNumber < firstHoleNumber_ || index >= flags_.size() || !(flags_[index] & Found))
+        return result;
+
+    result.found = true;
+    result.hasHqRegion = (flags_[index] & HasHqRegion) != 0;
+    result.hqRegion = hqRegions_[index];
+    result.adaptersBegin = adapters_.data() + adapterOffsets_[index];
+    result.adaptersEnd   = adapters_.data() + adapterOffsets_[index+1];
+    return result;
+}
+
+size_t RegionIndex::HqLength(const ZmwRegions& zmwRegions, const size_t readLength)
+{
+    const size_t hqStart = zmwRegions.hqRegion.start;
+    size_t hqEnd = zmwRegions.hqRegion.end;
+    hqEnd = (hqEnd == readLength-1) ? readLength : hqEnd;
+    return (hqEnd > hqStart ? hqEnd - hqStart : 0);
+}
@@ -0,0 +1,67 @@
+#ifndef REGIONINDEX_H
+#define REGIONINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <alignment/utils/RegionUtils.hpp>
+
+//
+// RegionIndex is a flat (compressed-sparse-row) copy of one BAX file's region
+// table, indexed directly by hole number.
+//
+// Each ZMW's HQ region is stored inline, and its adapters are a slice of one
+// shared array. Adapters are sorted, trimmed so they do not overlap, and
+// stripped of empty entries once, when the index is built, so per-ZMW lookups
+// neither copy nor allocate.
+//
+class RegionIndex
+{
+public:
+    struct Interval
+    {
+        int start;
+        int end;
+    };
+
+    // Regions of one ZMW. 'adapters' point into the index.
+    struct ZmwRegions
+    {
+        bool found;                 // hole number is in the region table
+        bool hasHqRegion;           // as RegionAnnotations::HasHQRegion()
+        Interval hqRegion;          // (0,0) if no HQ region
+        const Interval* adaptersBegin;
+        const Interval* adaptersEnd;
+    };
+
+public:
+    RegionIndex(void);
+
+public:
+    // Indexes the regions of 'holeNumbers' (the ZMWs of the BAX file).
+    void Build(const RegionTable& regionTable,
+               const std::vector<UInt>& holeNumbers);
+
+    ZmwRegions Find(const UInt holeNumber) const;
+
+    // Length of a ZMW's HQ region, with a 1-off end repaired as the
+    // converters do. 0 if it has none, or it is empty or invalid.
+    static size_t HqLength(const ZmwRegions& zmwRegions, const size_t readLength);
+
+private:
+    enum Flags
+    {
+        Found       = 0x1,
+        HasHqRegion = 0x2
+    };
+
+private:
+    UInt firstHoleNumber_;
+    std::vector<uint8_t> flags_;              // per hole number
+    std::vector<Interval> hqRegions_;         // per hole number
+    std::vector<uint32_t> adapterOffsets_;    // per hole number, +1
+    std::vector<Interval> adapters_;
+};
+
+#endif // REGIONINDEX_H
@@ -3,6 +3,11 @@
 #include "Settings.h"
 #include "OptionParser.h"
 
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
 #include <sstream>
 
 #include <boost/algorithm/string.hpp>
@@ -57,6 +62,65 @@ std::vector<std::string> FilenamesFromFofn(const std::string& fileName)
     return retval;
 }
 
+// Hole numbers, one per line: either the number alone, or a read name
+// ("<movie>/<holeNumber>[/...]"). Blank lines & '#' comments are ignored.
+static
+bool HoleNumbersFromFile(const std::string& fileName,
+                         std::vector<uint32_t>* holeNumbers,
+                         std::vector<std::string>* errors)
+{
+    std::ifstream in(fileName);
+    if (!in) {
+        errors->push_back("could not open ZMW whitelist: "+fileName);
+        return false;
+    }
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        boost::algorithm::trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::string field = line;
+        const size_t slash = line.find('/');
+        if (slash != std::string::npos) {
+            const size_t end = line.find('/', slash+1);
+            field = line.substr(slash+1, (end == std::string::npos ? end : end-slash-1));
+        }
+
+        char* fieldEnd = nullptr;
+        errno = 0;
+        const unsigned long holeNumber = strtoul(field.c_str(), &fieldEnd, 10);
+        if (field.empty() || *fieldEnd != '\0' || field[0] == '-' || errno != 0 || holeNumber > UINT32_MAX) {
+            errors->push_back("invalid hole number in "+fileName+", line "+std::to_string(lineNumber)+": "+line);
+            return false;
+        }
+        holeNumbers->push_back(static_cast<uint32_t>(holeNumber));
+    }
+    if (holeNumbers->empty()) {
+        errors->push_back("ZMW whitelist is empty: "+fileName);
+        return false;
+    }
+    return true;
+}
+
+// Parses a non-negative decimal integer, the whole of 'text'.
+static
+bool ParseUnsigned(const std::string& text, uint64_t* value)
+{
+    if (text.empty() || !isdigit(static_cast<unsigned char>(text[0])))
+        return false;
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long long result = strtoull(text.c_str(), &end, 10);
+    if (*end != '\0' || errno != 0)
+        return false;
+    *value = result;
+    return true;
+}
+
 static
 bool isBasH5(const std::string& fileName)
 {
@@ -92,6 +156,22 @@ const char* Settings::Option::internalMode_   = "internalMode";
 const char* Settings::Option::outputXml_      = "outputXml";
 const char* Settings::Option::sequelPlatform_ = "sequelPlatform";
 const char* Settings::Option::allowUnsupportedChem_  = "allowUnsupportedChem";
+const char* Settings::Option::numThreads_     = "numThreads";
+const char* Settings::Option::prefetchDepth_  = "prefetchDepth";
+const char* Settings::Option::prefetchMemory_ = "prefetchMemory";
+const char* Settings::Option::inputVfd_       = "inputVfd";
+const char* Settings::Option::hdf5CacheMB_    = "hdf5CacheMB";
+const char* Settings::Option::compressionLevel_ = "compressionLevel";
+const char* Settings::Option::compression_    = "compression";
+const char* Settings::Option::report_         = "report";
+const char* Settings::Option::minReadScore_   = "minReadScore";
+const char* Settings::Option::minHqLength_    = "minHqLength";
+const char* Settings::Option::minSubreadLength_ = "minSubreadLength";
+const char* Settings::Option::zmwFraction_    = "zmwFraction";
+const char* Settings::Option::zmwSeed_        = "zmwSeed";
+const char* Settings::Option::zmwWhitelist_   = "zmwWhitelist";
+const char* Settings::Option::zmwRange_       = "zmwRange";
+const char* Settings::Option::shard_          = "shard";
 
 Settings::Settings(void)
     : mode(Settings::SubreadMode)
@@ -107,6 +187,23 @@ Settings::Settings(void)
     , usingSubstitutionQV(true)
     , usingSubstitutionTag(false)
     , losslessFrames(false)
+    , minReadScore(0.0f)
+    , minHqLength(0)
+    , minSubreadLength(0)
+    , zmwFraction(1.0)
+    , zmwSeed(0)
+    , zmwRangeBegin(0)
+    , zmwRangeEnd(UINT64_MAX)
+    , shardIndex(0)
+    , numShards(1)
+    , numThreads(1)
+    , prefetchDepth(4)
+    , prefetchMemoryMB(256)
+    , usingReadaheadVfd(false)
+    , hdf5CacheMB(0)
+    , compressionLevel(-1)
+    , adaptiveCompression(false)
+    , isReporting(false)
 { }
 
 Settings Settings::FromCommandLine(optparse::OptionParser& parser,
@@ -207,6 +304,156 @@ Settings Settings::FromCommandLine(optparse::OptionParser& parser,
     settings.losslessFrames = options.is_set(Settings::Option::losslessFrames_) ? options.get(Settings::Option::losslessFrames_)
                                                                                 : false;
 
+    // read filters
+    if (options.is_set(Settings::Option::minReadScore_)) {
+        const float minReadScore = options.get(Settings::Option::minReadScore_);
+        if (minReadScore < 0.0f || minReadScore > 1.0f)
+            settings.errors.push_back("minimum read score must be in [0,1]");
+        else
+            settings.minReadScore = minReadScore;
+    }
+    if (options.is_set(Settings::Option::minHqLength_)) {
+        const int minHqLength = options.get(Settings::Option::minHqLength_);
+        if (minHqLength < 0)
+            settings.errors.push_back("minimum HQ region length must not be negative");
+        else if (settings.mode != Settings::SubreadMode && settings.mode != Settings::HQRegionMode)
+            settings.errors.push_back("minimum HQ region length requires subread or HQ region mode");
+        else
+            settings.minHqLength = static_cast<size_t>(minHqLength);
+    }
+    if (options.is_set(Settings::Option::minSubreadLength_)) {
+        const int minSubreadLength = options.get(Settings::Option::minSubreadLength_);
+        if (minSubreadLength < 0)
+            settings.errors.push_back("minimum subread length must not be negative");
+        else if (settings.mode != Settings::SubreadMode)
+            settings.errors.push_back("minimum subread length requires subread mode");
+        else
+            settings.minSubreadLength = static_cast<size_t>(minSubreadLength);
+    }
+
+    // ZMW subsample
+    if (options.is_set(Settings::Option::zmwFraction_)) {
+        const double zmwFraction = options.get(Settings::Option::zmwFraction_);
+        if (zmwFraction <= 0.0 || zmwFraction > 1.0)
+            settings.errors.push_back("ZMW fraction must be in (0,1]");
+        else
+            settings.zmwFraction = zmwFraction;
+    }
+    if (options.is_set(Settings::Option::zmwSeed_)) {
+        const long zmwSeed = options.get(Settings::Option::zmwSeed_);
+        if (zmwSeed < 0 || zmwSeed > static_cast<long>(UINT32_MAX))
+            settings.errors.push_back("seed must be in [0,4294967295]");
+        else
+            settings.zmwSeed = static_cast<uint32_t>(zmwSeed);
+    }
+
+    // ZMW whitelist
+    if (options.is_set(Settings::Option::zmwWhitelist_)) {
+        settings.zmwWhitelistFilename = options[Settings::Option::zmwWhitelist_];
+        internal::HoleNumbersFromFile(settings.zmwWhitelistFilename,
+                                      &settings.zmwWhitelist,
+                                      &settings.errors);
+    }
+
+    // hole number range, "START:END", either end may be left out
+    if (options.is_set(Settings::Option::zmwRange_)) {
+        const std::string zmwRange = options[Settings::Option::zmwRange_];
+        const size_t colon = zmwRange.find(':');
+        const std::string begin = zmwRange.substr(0, colon);
+        const std::string end = (colon == std::string::npos ? "" : zmwRange.substr(colon+1));
+        if (colon == std::string::npos ||
+            (!begin.empty() && !internal::ParseUnsigned(begin, &settings.zmwRangeBegin)) ||
+            (!end.empty() && !internal::ParseUnsigned(end, &settings.zmwRangeEnd)) ||
+            settings.zmwRangeBegin >= settings.zmwRangeEnd)
+        {
+            settings.errors.push_back("invalid ZMW range: "+zmwRange+" (expected START:END)");
+        }
+    }
+
+    // shard, "i/n" with i in [1,n]
+    if (options.is_set(Settings::Option::shard_)) {
+        const std::string shard = options[Settings::Option::shard_];
+        const size_t slash = shard.find('/');
+        uint64_t index = 0;
+        uint64_t count = 0;
+        if (slash == std::string::npos ||
+            !internal::ParseUnsigned(shard.substr(0, slash), &index) ||
+            !internal::ParseUnsigned(shard.substr(slash+1), &count) ||
+            index < 1 || index > count)
+        {
+            settings.errors.push_back("invalid shard: "+shard+" (expected i/n, with 1 <= i <= n)");
+        }
+        else if (settings.mode == Settings::CCSMode)
+            settings.errors.push_back("sharding is not supported in CCS mode");
+        else {
+            settings.shardIndex = static_cast<size_t>(index - 1);
+            settings.numShards = static_cast<size_t>(count);
+        }
+    }
+
+    // number of conversion threads
+    if (options.is_set(Settings::Option::numThreads_)) {
+        const int numThreads = options.get(Settings::Option::numThreads_);
+        if (numThreads < 1)
+            settings.errors.push_back("number of threads must be at least 1");
+        else
+            settings.numThreads = static_cast<size_t>(numThreads);
+    }
+
+    // HDF5 read-ahead
+    if (options.is_set(Settings::Option::prefetchDepth_)) {
+        const int prefetchDepth = options.get(Settings::Option::prefetchDepth_);
+        if (prefetchDepth < 0)
+            settings.errors.push_back("prefetch depth must not be negative");
+        else
+            settings.prefetchDepth = static_cast<size_t>(prefetchDepth);
+    }
+    if (options.is_set(Settings::Option::prefetchMemory_)) {
+        const int prefetchMemoryMB = options.get(Settings::Option::prefetchMemory_);
+        if (prefetchMemoryMB < 0)
+            settings.errors.push_back("prefetch memory must not be negative");
+        else
+            settings.prefetchMemoryMB = static_cast<size_t>(prefetchMemoryMB);
+    }
+
+    // HDF5 file driver
+    if (options.is_set(Settings::Option::inputVfd_)) {
+        const std::string inputVfd = options[Settings::Option::inputVfd_];
+        if (inputVfd == "readahead")
+            settings.usingReadaheadVfd = true;
+        else if (inputVfd != "sec2")
+            settings.errors.push_back("unknown input VFD: "+inputVfd);
+    }
+
+    // HDF5 chunk cache
+    if (options.is_set(Settings::Option::hdf5CacheMB_)) {
+        const int hdf5CacheMB = options.get(Settings::Option::hdf5CacheMB_);
+        if (hdf5CacheMB < 0)
+            settings.errors.push_back("HDF5 cache size must not be negative");
+        else
+            settings.hdf5CacheMB = static_cast<size_t>(hdf5CacheMB);
+    }
+
+    // output compression
+    if (options.is_set(Settings::Option::compressionLevel_)) {
+        const int compressionLevel = options.get(Settings::Option::compressionLevel_);
+        if (compressionLevel < 0 || compressionLevel > 9)
+            settings.errors.push_back("compression level must be between 0 and 9");
+        else
+            settings.compressionLevel = compressionLevel;
+    }
+    if (options.is_set(Settings::Option::compression_)) {
+        const std::string compression = options[Settings::Option::compression_];
+        if (compression == "auto")
+            settings.adaptiveCompression = true;
+        else if (compression != "fixed")
+            settings.errors.push_back("unknown compression mode: "+compression);
+    }
+
+    // run report
+    settings.isReporting = options.is_set(Settings::Option::report_) ? options.get(Settings::Option::report_)
+                                                                     : false;
+
     // pulse features list
     if (options.is_set(Settings::Option::pulseFeatures_)) {
 
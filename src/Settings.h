@@ -2,6 +2,7 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -31,6 +32,22 @@ public:
         static const char* outputXml_;
         static const char* sequelPlatform_;
         static const char* allowUnsupportedChem_;
+        static const char* numThreads_;
+        static const char* prefetchDepth_;
+        static const char* prefetchMemory_;
+        static const char* inputVfd_;
+        static const char* hdf5CacheMB_;
+        static const char* compressionLevel_;
+        static const char* compression_;
+        static const char* report_;
+        static const char* minReadScore_;
+        static const char* minHqLength_;
+        static const char* minSubreadLength_;
+        static const char* zmwFraction_;
+        static const char* zmwSeed_;
+        static const char* zmwWhitelist_;
+        static const char* zmwRange_;
+        static const char* shard_;
     };
 
 public:
@@ -73,6 +90,36 @@ public:
     // frame data encoding
     bool losslessFrames;
 
+    // read filters, applied before bases are read (0 for no filter)
+    float minReadScore;         // ZMWs with a lower read score write nothing
+    size_t minHqLength;         // ZMWs with a shorter HQ region write nothing
+    size_t minSubreadLength;    // shorter subreads are not written
+
+    // ZMW subsample & whitelist (see ZmwSelection)
+    double zmwFraction;         // 1 for all ZMWs
+    uint32_t zmwSeed;
+    std::string zmwWhitelistFilename;
+    std::vector<uint32_t> zmwWhitelist;     // hole numbers, empty for all ZMWs
+    uint64_t zmwRangeBegin;     // hole numbers [begin, end)
+    uint64_t zmwRangeEnd;
+
+    // scatter/gather: convert slice 'shardIndex' (0-based) of 'numShards',
+    // balanced by number of bases
+    size_t shardIndex;
+    size_t numShards;
+
+    // performance
+    size_t numThreads;
+    size_t prefetchDepth;       // ZMW batches read ahead of conversion, per input file
+    size_t prefetchMemoryMB;    // cap on read-ahead data, 0 for no limit
+    bool usingReadaheadVfd;     // read input through ReadaheadFileDriver
+    size_t hdf5CacheMB;         // HDF5 chunk cache over all per-base datasets, 0 to size automatically
+    int compressionLevel;       // BGZF deflate level of output files (0-9), -1 for htslib's default
+    bool adaptiveCompression;   // adjust the level while writing, from 'compressionLevel' (or 6)
+
+    // print input statistics after conversion
+    bool isReporting;
+
     // program info
     std::string program;
     std::string args;
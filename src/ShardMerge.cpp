@@ -0,0 +1,233 @@
+#include "ShardMerge.h"
+#include "BgzfConcat.h"
+#include "PbiConcat.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/algorithm/string.hpp>
+
+#include <htslib/bgzf.h>
+#include <htslib/sam.h>
+
+#include <pbbam/DataSet.h>
+
+#include <unistd.h> // getcwd
+
+namespace internal {
+
+// Header lines of a BAM file, with the CL field of @PG lines removed.
+static
+std::vector<std::string> ComparableHeaderLines(const std::string& fn)
+{
+    BGZF* fp = bgzf_open(fn.c_str(), "r");
+    if (fp == nullptr)
+        throw std::runtime_error("could not open "+fn);
+    bam_hdr_t* header = bam_hdr_read(fp);
+    std::string text;
+    if (header) {
+        text.assign(header->text, header->l_text);
+        bam_hdr_destroy(header);
+    }
+    bgzf_close(fp);
+    if (header == nullptr)
+        throw std::runtime_error("could not read BAM header from "+fn);
+
+    std::vector<std::string> lines;
+    std::istringstream in(text.c_str());    // up to any NUL padding
+    std::string line;
+    while (std::getline(in, line)) {
+        if (boost::starts_with(line, "@PG")) {
+            const size_t cl = line.find("\tCL:");
+            if (cl != std::string::npos)
+                line.erase(cl, line.find('\t', cl+1) - cl);
+        }
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// The last two extensions of a file name, e.g. ".subreads.bam".
+static
+std::string Suffix(const std::string& fn)
+{
+    const size_t slash = fn.find_last_of('/');
+    const std::string basename = fn.substr(slash == std::string::npos ? 0 : slash+1);
+    const size_t last = basename.find_last_of('.');
+    if (last == std::string::npos || last == 0)
+        throw std::runtime_error("no file extension to name output after: "+fn);
+    const size_t previous = basename.find_last_of('.', last-1);
+    return basename.substr(previous == std::string::npos || previous == 0 ? last : previous);
+}
+
+// Path of a resource listed in dataset XML 'xmlFilename'.
+static
+std::string ResourcePath(const std::string& resourceId,
+                         const std::string& xmlFilename)
+{
+    std::string path = resourceId;
+    if (boost::starts_with(path, "file://"))
+        path.erase(0, 7);
+    if (!boost::starts_with(path, "/")) {
+        const size_t slash = xmlFilename.find_last_of('/');
+        if (slash != std::string::npos)
+            path = xmlFilename.substr(0, slash+1) + path;
+    }
+    return path;
+}
+
+// "file://" URI of an output file, as bax2bam writes into dataset XML.
+static
+std::string OutputUri(const std::string& fn)
+{
+    if (boost::starts_with(fn, "/"))
+        return "file://" + fn;
+
+    char cwd[FILENAME_MAX] = { };
+    std::string path;
+    if (getcwd(cwd, FILENAME_MAX) != nullptr) {
+        path = cwd;
+        path.append(1, '/');
+    }
+    return "file://" + path + fn;
+}
+
+static
+uint64_t ParseCount(const std::string& text, const std::string& xmlFilename)
+{
+    try {
+        return text.empty() ? 0 : std::stoull(text);
+    } catch (std::exception&) {
+        throw std::runtime_error("invalid record count or length in "+xmlFilename+": "+text);
+    }
+}
+
+} // namespace internal
+
+void ShardMerge::CheckHeaders(const std::vector<std::string>& bamFilenames)
+{
+    if (bamFilenames.empty())
+        return;
+
+    const std::vector<std::string> expected = internal::ComparableHeaderLines(bamFilenames.front());
+    for (size_t i = 1; i < bamFilenames.size(); ++i) {
+        const std::vector<std::string> lines = internal::ComparableHeaderLines(bamFilenames.at(i));
+        for (size_t j = 0; j < std::max(expected.size(), lines.size()); ++j) {
+            const std::string expectedLine = (j < expected.size() ? expected.at(j) : "(none)");
+            const std::string line = (j < lines.size() ? lines.at(j) : "(none)");
+            if (line != expectedLine) {
+                throw std::runtime_error("BAM header of "+bamFilenames.at(i)+" does not match "+
+                                         bamFilenames.front()+": '"+line+"' vs '"+expectedLine+"'");
+            }
+        }
+    }
+}
+
+void ShardMerge::MergeBams(const std::vector<std::string>& inputFilenames,
+                           const std::string& outputFilename)
+{
+    CheckHeaders(inputFilenames);
+
+    std::vector<std::string> inputPbiFilenames;
+    for (const std::string& fn : inputFilenames)
+        inputPbiFilenames.push_back(fn + ".pbi");
+
+    const std::vector<BgzfConcat::Segment> segments =
+        BgzfConcat::Concatenate(inputFilenames, outputFilename);
+    PbiConcat::Concatenate(inputPbiFilenames, segments, outputFilename + ".pbi");
+}
+
+void ShardMerge::MergeDatasets(const std::vector<std::string>& inputXmlFilenames,
+                               const std::string& outputPrefix)
+{
+    using namespace PacBio::BAM;
+
+    if (inputXmlFilenames.empty())
+        throw std::runtime_error("no dataset XML files to merge");
+
+    // main & scraps BAM files of each shard, and their record counts
+    std::vector<std::string> mainBams;
+    std::vector<std::string> scrapsBams;
+    std::string mainMetaType;
+    std::string scrapsMetaType;
+    uint64_t numRecords = 0;
+    uint64_t totalLength = 0;
+    for (const std::string& xmlFn : inputXmlFilenames) {
+        const DataSet shard(xmlFn);
+        const ExternalResources resources = shard.ExternalResources();
+        const size_t numMainBams = mainBams.size();
+        for (auto iter = resources.cbegin(); iter != resources.cend(); ++iter) {
+            ExternalResource e = (*iter);
+            if (!boost::ends_with(e.ResourceId(), ".bam"))
+                continue;
+            if (mainBams.size() != numMainBams)
+                throw std::runtime_error("more than one BAM file listed in "+xmlFn);
+            mainBams.push_back(internal::ResourcePath(e.ResourceId(), xmlFn));
+            mainMetaType = e.MetaType();
+
+            const ExternalResources nested = e.ExternalResources();
+            for (auto nestedIter = nested.cbegin(); nestedIter != nested.cend(); ++nestedIter) {
+                ExternalResource scraps = (*nestedIter);
+                if (boost::ends_with(scraps.ResourceId(), ".bam")) {
+                    scrapsBams.push_back(internal::ResourcePath(scraps.ResourceId(), xmlFn));
+                    scrapsMetaType = scraps.MetaType();
+                }
+            }
+        }
+        if (mainBams.size() == numMainBams)
+            throw std::runtime_error("no BAM file listed in "+xmlFn);
+
+        DataSetMetadata metadata = shard.Metadata();
+        numRecords += internal::ParseCount(metadata.NumRecords(), xmlFn);
+        totalLength += internal::ParseCount(metadata.TotalLength(), xmlFn);
+    }
+    if (!scrapsBams.empty() && scrapsBams.size() != mainBams.size())
+        throw std::runtime_error("shards do not all list a scraps BAM file");
+
+    const std::string mainBam = outputPrefix + internal::Suffix(mainBams.front());
+    MergeBams(mainBams, mainBam);
+    std::string scrapsBam;
+    if (!scrapsBams.empty()) {
+        scrapsBam = outputPrefix + internal::Suffix(scrapsBams.front());
+        MergeBams(scrapsBams, scrapsBam);
+    }
+
+    // the first shard's dataset, listing the merged files instead
+    DataSet dataset(inputXmlFilenames.front());
+    dataset.CreatedAt(ToIso8601(time(NULL)));
+
+    std::vector<ExternalResource> toRemove;
+    ExternalResources resources = dataset.ExternalResources();
+    for (auto iter = resources.cbegin(); iter != resources.cend(); ++iter) {
+        ExternalResource e = (*iter);
+        if (boost::ends_with(e.ResourceId(), ".bam"))
+            toRemove.push_back(e);
+    }
+    while (!toRemove.empty()) {
+        resources.Remove(toRemove.back());
+        toRemove.pop_back();
+    }
+
+    const std::string mainUri = internal::OutputUri(mainBam);
+    ExternalResource mainResource{ mainMetaType, mainUri };
+    mainResource.FileIndices().Add(FileIndex{ "PacBio.Index.PacBioIndex", mainUri + ".pbi" });
+    if (!scrapsBam.empty()) {
+        const std::string scrapsUri = internal::OutputUri(scrapsBam);
+        ExternalResource scrapsResource{ scrapsMetaType, scrapsUri };
+        scrapsResource.FileIndices().Add(FileIndex{ "PacBio.Index.PacBioIndex", scrapsUri + ".pbi" });
+        mainResource.ExternalResources().Add(scrapsResource);
+    }
+    resources.Add(mainResource);
+    dataset.ExternalResources(resources);
+
+    DataSetMetadata metadata = dataset.Metadata();
+    metadata.NumRecords(std::to_string(numRecords));
+    metadata.TotalLength(std::to_string(totalLength));
+    dataset.Metadata(metadata);
+
+    dataset.Save(outputPrefix + internal::Suffix(inputXmlFilenames.front()));
+}
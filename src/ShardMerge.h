@@ -0,0 +1,37 @@
+#ifndef SHARDMERGE_H
+#define SHARDMERGE_H
+
+#include <string>
+#include <vector>
+
+//
+// ShardMerge joins the outputs of a sharded conversion (bax2bam --shard i/n)
+// back into one BAM file, its PBI index, and optionally its dataset XML.
+//
+// Shards are joined with BgzfConcat & PbiConcat: compressed blocks are copied
+// verbatim after the first shard's header, and PBI file offsets are rebased,
+// so nothing is decompressed or recompressed. Shard headers must match, other
+// than in their @PG command lines (which name the shard and its output).
+//
+// Throws std::runtime_error on failure.
+//
+class ShardMerge
+{
+public:
+    // Joins shard BAM files (and their .pbi) into 'outputFilename' (and
+    // its .pbi), in the order given.
+    static void MergeBams(const std::vector<std::string>& inputFilenames,
+                          const std::string& outputFilename);
+
+    // Joins shard dataset XML files, and the BAM files (main & scraps) they
+    // list. Outputs are named 'outputPrefix' followed by the suffix of the
+    // first shard's corresponding file (e.g. ".subreads.bam",
+    // ".subreadset.xml").
+    static void MergeDatasets(const std::vector<std::string>& inputXmlFilenames,
+                              const std::string& outputPrefix);
+
+    // Throws if the headers of the BAM files differ (other than @PG CL).
+    static void CheckHeaders(const std::vector<std::string>& bamFilenames);
+};
+
+#endif // SHARDMERGE_H
@@ -3,7 +3,6 @@
 #include "SubreadConverter.h"
 
 #include <algorithm>
-#include <deque>
 #include <memory>
 
 #include <pbbam/BamRecord.h>
@@ -24,358 +23,273 @@ SubreadConverter::SubreadConverter(Settings& settings)
 
 SubreadConverter::~SubreadConverter(void) { }
 
-struct SubreadInterval
-{
-    size_t Start;
-    size_t End;
-    PacBio::BAM::LocalContextFlags LocalContextFlags;
-
-    SubreadInterval()
-        : Start{0}
-        , End{0}
-        , LocalContextFlags{NO_LOCAL_CONTEXT}
-    { }
-
-    SubreadInterval(size_t start, size_t end, bool adapterBefore = false, bool adapterAfter = false)
-        : Start{start}
-        , End{end}
-        , LocalContextFlags{(adapterBefore ? ADAPTER_BEFORE : NO_LOCAL_CONTEXT) |
-                            (adapterAfter  ? ADAPTER_AFTER  : NO_LOCAL_CONTEXT)}
-    { }
-};
-
 namespace {
 
-struct ReadIntervalComparer {
-    bool operator()(const ReadInterval& lhs, const ReadInterval& rhs) const {
-        if (lhs.start == rhs.start)
-            return lhs.end < rhs.end;
-        return lhs.start < rhs.start;
-    }
-};
-
-SubreadInterval ComputeSubreadIntervals(std::deque<SubreadInterval>* const intervals,
-                                        std::deque<SubreadInterval>* const adapters,
-                                        RegionTable& regionTable,
-                                        const unsigned holeNumber,
-                                        const size_t readLength)
+// Adds the pieces of a ZMW's read to 'plan', in query order: the 5'
+// low-quality end, subreads & adapters within the HQ region, then the 3'
+// low-quality end. Returns the (possibly repaired) HQ region; (0,0) if the
+// ZMW has none.
+RegionIndex::Interval PlanIntervals(IntervalPlan* const plan,
+                                    const RegionIndex::ZmwRegions& zmwRegions,
+                                    const size_t readLength)
 {
-    constexpr int RegionStart = RegionAnnotation::REGIONSTARTCOL;
-    constexpr int RegionEnd   = RegionAnnotation::REGIONENDCOL;
-
-    // clear the input first
-    intervals->clear();
-    adapters->clear();
+    plan->clear();
 
-    // region annotations of a zmw
-    RegionAnnotations zmwRegions = regionTable[holeNumber];
+    size_t hqStart = 0;
+    size_t hqEnd   = 0;
 
     // Has non-empty HQregion or not?
-    if (!zmwRegions.HasHQRegion())
-        return SubreadInterval(0, 0);
-
-    size_t hqStart = zmwRegions.HQStart();
-    size_t hqEnd   = zmwRegions.HQEnd();
-
-    // Catch and repair 1-off errors in the HQ region
-    hqEnd = (hqEnd == readLength-1) ? readLength : hqEnd;
-
-    // Catch empty or invalid HQ regions and return empty
-    if (hqEnd <= hqStart)
-        return SubreadInterval(0, 0);
-
-    // adapter intervals of this zmw
-    std::vector<ReadInterval> adapterIntervals = zmwRegions.AdapterIntervals();
-
-    // Catch and trim overlapping adapter calls
-    // Shared starts indicate multiple alignments for the same adapter
-    // Unique starts indicate multiple overlapping adapters
-    // Therefore we trim adapter ends and remove any 0-length adapters
-    // such that the number of adapter regions == number of adapters
-    stable_sort(adapterIntervals.begin(), adapterIntervals.end(), ReadIntervalComparer());
-    for (size_t i = 1; i < adapterIntervals.size(); i++) {
-        if (adapterIntervals[i-1].end > adapterIntervals[i].start)
-            adapterIntervals[i-1].end = adapterIntervals[i].start;
+    if (zmwRegions.hasHqRegion) {
+        hqStart = zmwRegions.hqRegion.start;
+        hqEnd   = zmwRegions.hqRegion.end;
+
+        // Catch and repair 1-off errors in the HQ region
+        hqEnd = (hqEnd == readLength-1) ? readLength : hqEnd;
+
+        // Catch empty or invalid HQ regions and treat as empty
+        if (hqEnd <= hqStart)
+            hqStart = hqEnd = 0;
     }
-    adapterIntervals.erase(
-            std::remove_if(adapterIntervals.begin(), adapterIntervals.end(),
-                    [](const ReadInterval& interval) { return interval.start == interval.end; }),
-            adapterIntervals.end());
 
-    size_t subreadStart  = hqStart;
-    bool   adapterBefore = false;
+    // 5'-end LQ sequence
+    if (hqStart > 0)
+        plan->push_back(PlannedInterval{ PlannedInterval::LowQuality, 0, static_cast<int>(hqStart), NO_LOCAL_CONTEXT });
+
+    if (hqEnd > hqStart) {
+        size_t subreadStart  = hqStart;
+        bool   adapterBefore = false;
 
-    for (size_t i = 0; i < adapterIntervals.size(); i++) {
+        // adapter intervals of this zmw, already sorted & trimmed by the index
+        for (const RegionIndex::Interval* adapter = zmwRegions.adaptersBegin; adapter != zmwRegions.adaptersEnd; ++adapter) {
 
-        size_t adapterStart = adapterIntervals[i].start;
-        size_t adapterEnd   = adapterIntervals[i].end;
+            size_t adapterStart = adapter->start;
+            size_t adapterEnd   = adapter->end;
 
-        // if we're not in the HQRegion yet, skip ahead
-        if (hqStart > adapterEnd)
-            continue;
+            // if we're not in the HQRegion yet, skip ahead
+            if (hqStart > adapterEnd)
+                continue;
 
-        // if the adapter is beyond the HQRegion, we're done
-        if (hqEnd < adapterStart)
-            break;
+            // if the adapter is beyond the HQRegion, we're done
+            if (hqEnd < adapterStart)
+                break;
+
+            // If the subread is greater than length=0, save it
+            if (subreadStart < adapterStart) {
+                const uint8_t flags = (adapterBefore ? ADAPTER_BEFORE : NO_LOCAL_CONTEXT) | ADAPTER_AFTER;
+                plan->push_back(PlannedInterval{ PlannedInterval::Subread,
+                                                 static_cast<int>(subreadStart),
+                                                 static_cast<int>(adapterStart),
+                                                 flags });
+            }
 
-        // If the subread is greater than length=0, save it
-        if (subreadStart < adapterStart)
-            intervals->emplace_back(SubreadInterval(subreadStart, adapterStart, adapterBefore, true));
+            // Save the region of the adapter that overlaps the HQ region
+            plan->push_back(PlannedInterval{ PlannedInterval::Adapter,
+                                             static_cast<int>(MAX3(adapterStart, hqStart, subreadStart)),
+                                             static_cast<int>(std::min(adapterEnd, hqEnd)),
+                                             NO_LOCAL_CONTEXT });
 
-        // Save the region of the adapter that overlaps the HQ region
-        adapters->emplace_back(SubreadInterval(MAX3(adapterStart, hqStart, subreadStart),
-                    std::min(adapterEnd, hqEnd)));
+            subreadStart  = adapterEnd;
+            adapterBefore = true;
+        }
 
-        subreadStart  = adapterEnd;
-        adapterBefore = true;
+        // Save any region between the last adatper and the end of the HQ region as a subread
+        if (subreadStart < hqEnd) {
+            const uint8_t flags = (adapterBefore ? ADAPTER_BEFORE : NO_LOCAL_CONTEXT);
+            plan->push_back(PlannedInterval{ PlannedInterval::Subread,
+                                             static_cast<int>(subreadStart),
+                                             static_cast<int>(hqEnd),
+                                             flags });
+        }
     }
 
-    // Save any region between the last adatper and the end of the HQ region as a subread
-    if (subreadStart < hqEnd)
-        intervals->emplace_back(SubreadInterval(subreadStart, hqEnd, adapterBefore, false));
+    // 3'-end LQ sequence
+    if (hqEnd < readLength)
+        plan->push_back(PlannedInterval{ PlannedInterval::LowQuality, static_cast<int>(hqEnd), static_cast<int>(readLength), NO_LOCAL_CONTEXT });
 
-    return SubreadInterval(hqStart, hqEnd);
+    return RegionIndex::Interval{ static_cast<int>(hqStart), static_cast<int>(hqEnd) };
 }
 
 } // anon
 
-bool SubreadConverter::ConvertFile(HDFBasReader* reader,
-                                   PacBio::BAM::BamWriter* writer)
-{
-    return ConvertFile(reader, writer, nullptr);
-}
-
-bool SubreadConverter::ConvertFile(HDFBasReader* reader,
-                                   PacBio::BAM::BamWriter* writer,
-                                   PacBio::BAM::BamWriter* scrapsWriter)
+bool SubreadConverter::InitFile(HDFBasReader* reader, const size_t fileIndex)
 {
     assert(reader);
 
-    // initialize with default values (shared across all unmapped subreads)
-    BamRecordImpl bamRecord;
-
     // read region table info
     std::unique_ptr<HDFRegionTableReader> const regionTableReader(new HDFRegionTableReader);
-    RegionTable regionTable;
     std::string fn = filenameForReader_[reader];
     assert(!fn.empty());
-    if (regionTableReader->Initialize(fn) == 0) {
+    if (regionTableReader->Initialize(fn, fileAccess_) == 0) {
         AddErrorMessage("could not read region table on "+fn);
         return false;
     }
-    regionTable.Reset();
+    RegionTable regionTable;
     regionTableReader->ReadTable(regionTable);
     regionTableReader->Close();
 
+    // flatten it, for per-ZMW lookups without copies
+    std::vector<UInt> holeNumbers;
+    ReadHoleNumbers(reader, &holeNumbers);
+    if (regionIndices_.size() <= fileIndex)
+        regionIndices_.resize(fileIndex + 1);
+    regionIndices_.at(fileIndex).Build(regionTable, holeNumbers);
+
     // initialize read scores
-    InitReadScores(reader);
-
-    // fetch records from HDF5 file
-    SMRTSequence smrtRecord;
-    while (reader->GetNext(smrtRecord)) {
-
-        // compute subread & adapter intervals
-        SubreadInterval hqInterval;
-        std::deque<SubreadInterval> subreadIntervals;
-        std::deque<SubreadInterval> adapterIntervals;
-        try {
-            hqInterval = ComputeSubreadIntervals(&subreadIntervals,
-                                                 &adapterIntervals,
-                                                 regionTable,
-                                                 smrtRecord.zmwData.holeNumber,
-                                                 smrtRecord.length);
-        } catch (std::runtime_error& e) {
-            AddErrorMessage(std::string(e.what()));
-            smrtRecord.Free();
-            return false;
-        }
+    return ConverterBase::InitFile(reader, fileIndex);
+}
 
-        // sequencing ZMW
-        if (IsSequencingZmw(smrtRecord))
-        {
-            // write subreads to main BAM file
-            for (const SubreadInterval& interval : subreadIntervals)
-            {
-                // skip invalid or 0-sized intervals
-                if (interval.End <= interval.Start)
-                    continue;
-
-                if (!WriteSubreadRecord(smrtRecord,
-                                        interval.Start,
-                                        interval.End,
-                                        ReadGroupId(),
-                                        static_cast<uint8_t>(interval.LocalContextFlags),
-                                        writer))
-                {
-                    smrtRecord.Free();
-                    return false;
-                }
-            }
+bool SubreadConverter::PassesFilters(const ZmwSummary& zmw) const
+{
+    if (!ConverterBase::PassesFilters(zmw))
+        return false;
+    if (settings_.minHqLength == 0)
+        return true;
 
-            // if scraps BAM file present
-            if (scrapsWriter)
-            {
-                // write 5-end LQ sequence
-                if (hqInterval.Start > 0)
-                {
-                    if (!WriteLowQualityRecord(smrtRecord,
-                                               0,
-                                               hqInterval.Start,
-                                               ScrapsReadGroupId(),
-                                               scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
-                }
+    const RegionIndex::ZmwRegions zmwRegions =
+            regionIndices_.at(zmw.fileIndex).Find(zmw.holeNumber);
+    return RegionIndex::HqLength(zmwRegions, zmw.readLength) >= settings_.minHqLength;
+}
 
-                // write adapters
-                for (const SubreadInterval& interval : adapterIntervals) {
+bool SubreadConverter::EmitsRecords(const ZmwSummary& zmw)
+{
+    // same decisions as ConvertZmw(), without the bases
+    const bool hasScraps = !settings_.scrapsBamFilename.empty();
+    const bool isSequencing = IsSequencingZmw(zmw.holeStatus);
+    if (!isSequencing && !(settings_.isInternal && hasScraps))
+        return false;
 
-                    // skip invalid or 0-sized adapters
-                    if (interval.End <= interval.Start)
-                        continue;
-
-                    if (!WriteAdapterRecord(smrtRecord,
-                                            interval.Start,
-                                            interval.End,
-                                            ScrapsReadGroupId(),
-                                            scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
-                }
+    PlanIntervals(&selectionPlan_,
+                  regionIndices_.at(zmw.fileIndex).Find(zmw.holeNumber),
+                  zmw.readLength);
+    if (!isSequencing)
+        return !selectionPlan_.empty();
+
+    bool emits = false;
+    size_t numShortSubreads = 0;
+    for (const PlannedInterval& interval : selectionPlan_) {
+        switch (interval.type) {
+            case PlannedInterval::Subread    : if (IsShortSubread(interval)) ++numShortSubreads; else emits = true; break;
+            case PlannedInterval::Adapter    : emits = emits || (hasScraps && interval.start < interval.end); break;
+            case PlannedInterval::LowQuality : emits = emits || hasScraps; break;
+        }
+    }
 
-                // write 3'-end LQ sequence
-                if (hqInterval.End < smrtRecord.length)
-                {
-                    if (!WriteLowQualityRecord(smrtRecord,
-                                               hqInterval.End,
-                                               smrtRecord.length,
-                                               ScrapsReadGroupId(),
-                                               scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
-                }
-            }
-        } // sequencing ZMW
+    // ZMWs that are read count their own short subreads, when converted
+    if (!emits)
+        numRecordsFiltered_ += numShortSubreads;
+    return emits;
+}
 
-        // non-sequencing ZMW
-        else
-        {
-            assert(!IsSequencingZmw(smrtRecord));
+bool SubreadConverter::IsShortSubread(const PlannedInterval& interval) const
+{ return static_cast<size_t>(interval.end - interval.start) < settings_.minSubreadLength; }
 
-            // only write these if scraps BAM present & we are in 'internal mode'
-            if (settings_.isInternal && scrapsWriter)
+bool SubreadConverter::ConvertZmw(const SMRTSequence& smrtRecord,
+                                  ConversionContext* context,
+                                  RecordBuffer* records,
+                                  RecordBuffer* scraps)
+{
+    // compute LQ, subread & adapter intervals
+    IntervalPlan& plan = context->intervals;
+    PlanIntervals(&plan,
+                  regionIndices_.at(context->fileIndex).Find(smrtRecord.zmwData.holeNumber),
+                  smrtRecord.length);
+
+    // sequencing ZMW: subreads to main BAM file, everything else to scraps
+    // (if present)
+    if (IsSequencingZmw(smrtRecord))
+    {
+        for (const PlannedInterval& interval : plan)
+        {
+            bool ok = true;
+            switch (interval.type)
             {
-                // write 5-end LQ sequence to scraps BAM
-                if (hqInterval.Start > 0)
-                {
-                    if (!WriteLowQualityRecord(smrtRecord,
-                                               0,
-                                               hqInterval.Start,
-                                               ScrapsReadGroupId(),
-                                               scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
-                }
-
-                // write subreads & adapters to scraps BAM, sorted by query start
-                while (!subreadIntervals.empty() && !adapterIntervals.empty()) {
-
-                    const SubreadInterval& subread = subreadIntervals.front();
-                    const SubreadInterval& adapter = adapterIntervals.front();
-                    assert(subread.Start != adapter.Start);
-
-                    if (subread.Start < adapter.Start)
-                    {
-                        if (!WriteFilteredRecord(smrtRecord,
-                                                 subread.Start,
-                                                 subread.End,
-                                                 ScrapsReadGroupId(),
-                                                 static_cast<uint8_t>(subread.LocalContextFlags),
-                                                 scrapsWriter))
-                        {
-                            smrtRecord.Free();
-                            return false;
-                        }
-
-                        subreadIntervals.pop_front();
+                case PlannedInterval::Subread :
+                    if (IsShortSubread(interval)) {
+                        ++numRecordsFiltered_;
+                        break;
                     }
-                    else
-                    {
-                        if (!WriteAdapterRecord(smrtRecord,
-                                                adapter.Start,
-                                                adapter.End,
+                    ok = WriteSubreadRecord(smrtRecord,
+                                            interval.start,
+                                            interval.end,
+                                            ReadGroupId(),
+                                            interval.contextFlags,
+                                            context,
+                                            records);
+                    break;
+
+                case PlannedInterval::Adapter :
+                    // skip invalid or 0-sized adapters
+                    if (scraps && interval.start < interval.end)
+                        ok = WriteAdapterRecord(smrtRecord,
+                                                interval.start,
+                                                interval.end,
                                                 ScrapsReadGroupId(),
-                                                scrapsWriter))
-                        {
-                            smrtRecord.Free();
-                            return false;
-                        }
-                        adapterIntervals.pop_front();
-                    }
-                }
-
-                // flush any traling subread intervals
-                while (!subreadIntervals.empty())
-                {
-                    assert(adapterIntervals.empty());
-                    const SubreadInterval& subread = subreadIntervals.front();
-                    if (!WriteFilteredRecord(smrtRecord,
-                                             subread.Start,
-                                             subread.End,
-                                             ScrapsReadGroupId(),
-                                             static_cast<uint8_t>(subread.LocalContextFlags),
-                                             scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
-
-                    subreadIntervals.pop_front();
-                }
+                                                context,
+                                                scraps);
+                    break;
+
+                case PlannedInterval::LowQuality :
+                    if (scraps)
+                        ok = WriteLowQualityRecord(smrtRecord,
+                                                   interval.start,
+                                                   interval.end,
+                                                   ScrapsReadGroupId(),
+                                                   context,
+                                                   scraps);
+                    break;
+            }
+            if (!ok)
+                return false;
+        }
+    } // sequencing ZMW
 
-                // flush any remaining adapter intervals
-                while (!adapterIntervals.empty())
-                {
-                    assert(subreadIntervals.empty());
-                    const SubreadInterval& adapter = adapterIntervals.front();
-                    if (!WriteAdapterRecord(smrtRecord,
-                                            adapter.Start,
-                                            adapter.End,
-                                            ScrapsReadGroupId(),
-                                            scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
-                    adapterIntervals.pop_front();
-                }
+    // non-sequencing ZMW
+    else
+    {
+        assert(!IsSequencingZmw(smrtRecord));
 
-                // write 3'-end LQ sequence to scraps BAM
-                if (hqInterval.End < smrtRecord.length)
+        // only write these if scraps BAM present & we are in 'internal mode'
+        if (settings_.isInternal && scraps)
+        {
+            // everything to scraps BAM, sorted by query start
+            for (const PlannedInterval& interval : plan)
+            {
+                bool ok = true;
+                switch (interval.type)
                 {
-                    if (!WriteLowQualityRecord(smrtRecord,
-                                               hqInterval.End,
-                                               smrtRecord.length,
-                                               ScrapsReadGroupId(),
-                                               scrapsWriter))
-                    {
-                        smrtRecord.Free();
-                        return false;
-                    }
+                    case PlannedInterval::Subread :
+                        ok = WriteFilteredRecord(smrtRecord,
+                                                 interval.start,
+                                                 interval.end,
+                                                 ScrapsReadGroupId(),
+                                                 interval.contextFlags,
+                                                 context,
+                                                 scraps);
+                        break;
+
+                    case PlannedInterval::Adapter :
+                        ok = WriteAdapterRecord(smrtRecord,
+                                                interval.start,
+                                                interval.end,
+                                                ScrapsReadGroupId(),
+                                                context,
+                                                scraps);
+                        break;
+
+                    case PlannedInterval::LowQuality :
+                        ok = WriteLowQualityRecord(smrtRecord,
+                                                   interval.start,
+                                                   interval.end,
+                                                   ScrapsReadGroupId(),
+                                                   context,
+                                                   scraps);
+                        break;
                 }
+                if (!ok)
+                    return false;
             }
-        } // non-sequencing ZMW
-
-        smrtRecord.Free();
-    }
+        }
+    } // non-sequencing ZMW
 
     // if we get here, all OK
     return true;
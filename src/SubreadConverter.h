@@ -4,6 +4,7 @@
 #define SUBREADCONVERTER_H
 
 #include "ConverterBase.h"
+#include "RegionIndex.h"
 
 class SubreadConverter : public ConverterBase<>
 {
@@ -12,15 +13,25 @@ public:
     ~SubreadConverter(void);
 
 protected:
-    bool ConvertFile(HDFBasReader* reader,
-                     PacBio::BAM::BamWriter* writer);
-    bool ConvertFile(HDFBasReader* reader,
-                     PacBio::BAM::BamWriter* writer,
-                     PacBio::BAM::BamWriter* scrapsWriter);
+    bool InitFile(HDFBasReader* reader, const size_t fileIndex);
+    bool PassesFilters(const ZmwSummary& zmw) const;
+    bool EmitsRecords(const ZmwSummary& zmw);
+
+    // Whether a subread is dropped by --min-subread-length.
+    bool IsShortSubread(const PlannedInterval& interval) const;
+
+    bool ConvertZmw(const SMRTSequence& smrtRecord,
+                    ConversionContext* context,
+                    RecordBuffer* records,
+                    RecordBuffer* scraps);
     std::string HeaderReadType(void) const;
     std::string ScrapsReadType(void) const;
     std::string OutputFileSuffix(void) const;
     std::string ScrapsFileSuffix(void) const;
+
+protected:
+    std::vector<RegionIndex> regionIndices_;   // per input file
+    IntervalPlan selectionPlan_;               // used by EmitsRecords()
 };
 
 #endif // SUBREADCONVERTER_H
@@ -0,0 +1,86 @@
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+TaskPool::TaskPool(const size_t numThreads)
+    : numThreads_(numThreads)
+    , pool_(nullptr)
+    , process_(nullptr)
+{
+    if (numThreads_ == 0)
+        return;
+
+    // helpers only queue up to one per thread and job, so 'qsize' just
+    // needs to cover a few concurrent jobs
+    pool_ = hts_tpool_init(static_cast<int>(numThreads_));
+    if (pool_)
+        process_ = hts_tpool_process_init(pool_, static_cast<int>(4 * numThreads_), 1);
+    if (process_ == nullptr) {
+        if (pool_)
+            hts_tpool_destroy(pool_);
+        throw std::runtime_error("could not start thread pool");
+    }
+}
+
+TaskPool::~TaskPool(void)
+{
+    if (pool_ == nullptr)
+        return;
+
+    // helpers still queued find nothing left to do, but own their argument
+    hts_tpool_process_flush(process_);
+    hts_tpool_process_destroy(process_);
+    hts_tpool_destroy(pool_);
+}
+
+void TaskPool::Work(Job* job)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (job->next < job->numTasks) {
+        const size_t index = job->next++;
+        lock.unlock();
+        (*job->task)(index);
+        lock.lock();
+
+        if (++job->numDone == job->numTasks)
+            jobDone_.notify_all();
+    }
+}
+
+void* TaskPool::Help(void* arg)
+{
+    std::unique_ptr<Helper> helper(static_cast<Helper*>(arg));
+    helper->pool->Work(helper->job.get());
+    return nullptr;
+}
+
+void TaskPool::Run(const size_t numTasks, const Task& task)
+{
+    if (numTasks == 0)
+        return;
+    if (pool_ == nullptr || numTasks == 1) {
+        for (size_t i = 0; i < numTasks; ++i)
+            task(i);
+        return;
+    }
+
+    // Helpers may start after the job is done (the pool is shared with BGZF
+    // compression), so they share ownership of it. They only touch 'task'
+    // after claiming an index, while Run() is still waiting.
+    std::shared_ptr<Job> job(new Job{ &task, numTasks, 0, 0 });
+    const size_t numHelpers = std::min(numThreads_, numTasks - 1);
+    for (size_t i = 0; i < numHelpers; ++i) {
+        Helper* helper = new Helper{ this, job };
+        if (hts_tpool_dispatch2(pool_, process_, &TaskPool::Help, helper, 1) != 0) {
+            // queue full: the caller does the rest
+            delete helper;
+            break;
+        }
+    }
+
+    // help out, then wait for tasks taken by pool threads
+    Work(job.get());
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobDone_.wait(lock, [&job]() { return job->numDone == job->numTasks; });
+}
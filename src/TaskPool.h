@@ -0,0 +1,77 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include <htslib/thread_pool.h>
+
+//
+// TaskPool runs short, independent tasks on a fixed set of threads.
+//
+// Run() hands out the indices [0, numTasks) of one job to the pool and to the
+// calling thread, and returns once all of them are done. Several threads may
+// Run() jobs at the same time, sharing the pool. With no pool threads, tasks
+// simply run on the caller.
+//
+// The threads are an htslib pool, which BAM writers share as well (they
+// compress their blocks on HtsPool()), so block compression and our tasks
+// draw on one set of threads.
+//
+// Tasks must not throw.
+//
+class TaskPool
+{
+public:
+    typedef std::function<void(size_t)> Task;
+
+public:
+    explicit TaskPool(const size_t numThreads);
+    ~TaskPool(void);
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+public:
+    size_t NumThreads(void) const { return numThreads_; }
+
+    // The underlying htslib pool, null without pool threads.
+    hts_tpool* HtsPool(void) const { return pool_; }
+
+    void Run(const size_t numTasks, const Task& task);
+
+private:
+    struct Job
+    {
+        const Task* task;
+        size_t numTasks;
+        size_t next;        // next index to hand out
+        size_t numDone;
+    };
+
+    // argument of a pool thread joining in a job
+    struct Helper
+    {
+        TaskPool* pool;
+        std::shared_ptr<Job> job;
+    };
+
+private:
+    // Runs indices of 'job' until none are left to hand out.
+    void Work(Job* job);
+    static void* Help(void* helper);
+
+private:
+    size_t numThreads_;
+    hts_tpool* pool_;
+    hts_tpool_process* process_;        // queue of our helpers
+
+    // guarded by mutex_
+    std::mutex mutex_;
+    std::condition_variable jobDone_;
+};
+
+#endif // TASKPOOL_H
@@ -0,0 +1,67 @@
+#include "ZmwSelection.h"
+#include "Settings.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace internal {
+
+// splitmix64 finalizer: cheap, and every input bit affects every output bit
+static inline
+uint64_t Mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+} // namespace internal
+
+ZmwSelection::ZmwSelection(const Settings& settings)
+    : fraction_(settings.zmwFraction)
+    , seed_(settings.zmwSeed)
+    , threshold_(0)
+    , whitelistFilename_(settings.zmwWhitelistFilename)
+    , whitelist_(settings.zmwWhitelist)
+    , rangeBegin_(settings.zmwRangeBegin)
+    , rangeEnd_(settings.zmwRangeEnd)
+{
+    // 2^64 * fraction; fractions of 1 or more select all ZMWs without hashing
+    if (fraction_ > 0.0 && fraction_ < 1.0)
+        threshold_ = static_cast<uint64_t>(fraction_ * 18446744073709551616.0);
+
+    std::sort(whitelist_.begin(), whitelist_.end());
+    whitelist_.erase(std::unique(whitelist_.begin(), whitelist_.end()), whitelist_.end());
+}
+
+bool ZmwSelection::SelectsAll(void) const
+{ return fraction_ >= 1.0 && whitelist_.empty() && rangeBegin_ == 0 && rangeEnd_ == UINT64_MAX; }
+
+bool ZmwSelection::Contains(const uint32_t holeNumber) const
+{
+    if (holeNumber < rangeBegin_ || holeNumber >= rangeEnd_)
+        return false;
+    if (!whitelist_.empty() && !std::binary_search(whitelist_.cbegin(), whitelist_.cend(), holeNumber))
+        return false;
+    if (fraction_ >= 1.0)
+        return true;
+    const uint64_t key = (static_cast<uint64_t>(seed_) << 32) | holeNumber;
+    return internal::Mix(key + 0x9e3779b97f4a7c15ULL) < threshold_;
+}
+
+std::vector<std::string> ZmwSelection::Tags(void) const
+{
+    std::vector<std::string> tags;
+    if (fraction_ < 1.0) {
+        std::ostringstream fraction;
+        fraction << fraction_;
+        tags.push_back("zmw-fraction=" + fraction.str());
+        tags.push_back("seed=" + std::to_string(seed_));
+    }
+    if (!whitelist_.empty()) {
+        const size_t slash = whitelistFilename_.find_last_of('/');
+        tags.push_back("zmw-whitelist=" + whitelistFilename_.substr(slash == std::string::npos ? 0 : slash+1));
+        tags.push_back("whitelist-zmws=" + std::to_string(whitelist_.size()));
+    }
+    return tags;
+}
@@ -0,0 +1,48 @@
+#ifndef ZMWSELECTION_H
+#define ZMWSELECTION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Settings;
+
+//
+// ZmwSelection decides from hole numbers alone which ZMWs of a movie are
+// converted: a deterministic subsample (--zmw-fraction, --seed), a whitelist
+// of hole numbers (--zmw-whitelist), and a range of hole numbers
+// (--zmw-range). Only ZMWs in all of those given are kept.
+//
+// For the subsample, each hole number is hashed with the seed, and kept if
+// the hash falls below the fraction of the hash range. The choice does not
+// depend on input file, thread count or run, so a sample is reproducible,
+// and a smaller fraction with the same seed is a subset of a larger one.
+//
+class ZmwSelection
+{
+public:
+    explicit ZmwSelection(const Settings& settings);
+
+public:
+    // Whether every ZMW is selected.
+    bool SelectsAll(void) const;
+
+    bool Contains(const uint32_t holeNumber) const;
+
+    // "key=value" descriptions of the selection, for output headers &
+    // dataset XML tags. Empty without a subsample or whitelist: hole number
+    // ranges are not described, so the shards of a scatter/gather conversion have
+    // identical headers.
+    std::vector<std::string> Tags(void) const;
+
+private:
+    double fraction_;
+    uint32_t seed_;
+    uint64_t threshold_;    // hashes below this are selected
+    std::string whitelistFilename_;
+    std::vector<uint32_t> whitelist_;       // sorted, empty for all ZMWs
+    uint64_t rangeBegin_;
+    uint64_t rangeEnd_;
+};
+
+#endif // ZMWSELECTION_H
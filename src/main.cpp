@@ -104,6 +104,121 @@ int main(int argc, char* argv[])
                       );
     parser.add_option_group(bamModeGroup);
 
+    auto filterGroup = optparse::OptionGroup(parser, "Read filters");
+    filterGroup.add_option("--min-rq")
+               .dest(Settings::Option::minReadScore_)
+               .type("float")
+               .metavar("FLOAT")
+               .help("Drop ZMWs whose read score (rq) is below this value. Dropped ZMWs "
+                     "are not read, and write no records, scraps included. [default: 0]");
+    filterGroup.add_option("--min-hq-length")
+               .dest(Settings::Option::minHqLength_)
+               .type("int")
+               .metavar("INT")
+               .help("Drop ZMWs whose HQ region is shorter than this, as above. Subread "
+                     "and HQ region modes only. [default: 0]");
+    filterGroup.add_option("--min-subread-length")
+               .dest(Settings::Option::minSubreadLength_)
+               .type("int")
+               .metavar("INT")
+               .help("Do not write subreads shorter than this. Subread mode only. "
+                     "[default: 0]");
+    parser.add_option_group(filterGroup);
+
+    auto sampleGroup = optparse::OptionGroup(parser, "ZMW selection");
+    sampleGroup.add_option("--zmw-fraction")
+               .dest(Settings::Option::zmwFraction_)
+               .type("double")
+               .metavar("FLOAT")
+               .help("Convert only this fraction of ZMWs, chosen by a hash of hole number, "
+                     "for quick QC runs. Other ZMWs are not read. The sample is the same for "
+                     "a given seed on every run, and is recorded in the BAM header (@CO) and "
+                     "output dataset XML tags. [default: 1]");
+    sampleGroup.add_option("--seed")
+               .dest(Settings::Option::zmwSeed_)
+               .type("long")
+               .metavar("INT")
+               .help("Seed of the --zmw-fraction hash. [default: 0]");
+    sampleGroup.add_option("--zmw-whitelist")
+               .dest(Settings::Option::zmwWhitelist_)
+               .metavar("FILE")
+               .help("Convert only the ZMWs listed in FILE, one hole number (or read name) "
+                     "per line. Only their bases are read, so a few ZMWs are extracted without "
+                     "scanning the movie. Combines with --zmw-fraction.");
+    sampleGroup.add_option("--zmw-range")
+               .dest(Settings::Option::zmwRange_)
+               .metavar("START:END")
+               .help("Convert only ZMWs with hole numbers in [START, END). Either end may be "
+                     "left out.");
+    sampleGroup.add_option("--shard")
+               .dest(Settings::Option::shard_)
+               .metavar("i/n")
+               .help("Convert only slice i (1-based) of n, for scatter/gather conversion. "
+                     "Slices are contiguous in input order across all BAX parts, and balanced "
+                     "by number of bases. Each shard reads only its own ZMWs' data, and writes "
+                     "its own BAM & PBI, with the same headers as every other shard. Not "
+                     "supported in CCS mode.");
+    parser.add_option_group(sampleGroup);
+
+    auto performanceGroup = optparse::OptionGroup(parser, "Performance options");
+    performanceGroup.add_option("-j", "--threads")
+                    .dest(Settings::Option::numThreads_)
+                    .type("int")
+                    .metavar("INT")
+                    .help("Total number of threads: HDF5 reads, conversion of ZMWs, input "
+                          "decompression, output compression & writes all share them, and no "
+                          "more are started. With multiple BAX parts, parts are converted "
+                          "concurrently (one per 4 threads) and joined without recompression. "
+                          "Records are always written in their original order, so output "
+                          "contents are identical for any thread count. [default: 1]");
+    performanceGroup.add_option("--prefetch-depth")
+                    .dest(Settings::Option::prefetchDepth_)
+                    .type("int")
+                    .metavar("INT")
+                    .help("Number of ZMW batches read from each BAX file ahead of conversion, "
+                          "on a dedicated reader thread, so HDF5 reads overlap with conversion. "
+                          "0 reads and converts in turn on a single thread, as does --threads 1. "
+                          "[default: 4]");
+    performanceGroup.add_option("--prefetch-mb")
+                    .dest(Settings::Option::prefetchMemory_)
+                    .type("int")
+                    .metavar("INT")
+                    .help("Upper bound, in MB, on read-ahead data waiting for conversion, "
+                          "shared by all files converted at once. 0 for no limit. [default: 256]");
+    performanceGroup.add_option("--input-vfd")
+                    .dest(Settings::Option::inputVfd_)
+                    .metavar("STRING")
+                    .help("HDF5 file driver used to read input files: 'sec2' (HDF5's default) or "
+                          "'readahead', which reads large sequential windows, for slow or network "
+                          "storage. [default: sec2]");
+    performanceGroup.add_option("--hdf5-cache-mb")
+                    .dest(Settings::Option::hdf5CacheMB_)
+                    .type("int")
+                    .metavar("INT")
+                    .help("Size, in MB, of the HDF5 chunk cache, split across the per-base datasets "
+                          "read. 0 sizes it from the datasets' chunk dimensions. [default: 0]");
+    performanceGroup.add_option("--compression-level")
+                    .dest(Settings::Option::compressionLevel_)
+                    .type("int")
+                    .metavar("INT")
+                    .help("Deflate level of output BAM files, main & scraps: 0 (stored) to 9 "
+                          "(smallest). Low levels are much faster, especially with an htslib "
+                          "built against libdeflate. [default: htslib's, 6]");
+    performanceGroup.add_option("--compression")
+                    .dest(Settings::Option::compression_)
+                    .metavar("STRING")
+                    .help("'fixed' compresses at --compression-level. 'auto' starts there, then "
+                          "raises or lowers the level (1-9) as output is written, whichever "
+                          "writes faster: lower where compression is the bottleneck, higher "
+                          "where I/O is. Levels used are listed by --report. [default: fixed]");
+    performanceGroup.add_option("--report")
+                    .dest(Settings::Option::report_)
+                    .action("store_true")
+                    .help("Print input statistics (chunk cache, read-ahead), output compression & "
+                          "write times, and levels chosen by --compression auto, to stderr after "
+                          "conversion.");
+    parser.add_option_group(performanceGroup);
+
     auto additionalGroup = optparse::OptionGroup(parser, "Additional options");
     additionalGroup.add_option("--allowUnrecognizedChemistryTriple")
                    .dest(Settings::Option::allowUnsupportedChem_)